@@ -0,0 +1,216 @@
+#pragma once
+
+#include "fractal-mp/pch.hpp"
+
+// Sign-magnitude fixed point number on N 64-bit limbs (least significant first),
+// value = mag / 2^(64N - int_bits). Everything the escape loop touches stays
+// below 2^int_bits in magnitude, so none of MPFR's exponent handling is needed.
+// Products are truncated
+template<int N>
+struct Fixed
+{
+	static_assert(N >= 2 and N <= 8);
+
+	static constexpr int int_bits = 8;
+	static constexpr int frac_bits = 64 * N - int_bits;
+
+	uint64_t mag[N];
+	bool neg;
+
+	static Fixed zero()
+	{
+		return {};
+	}
+
+	static Fixed from_mpfr(mpfr_srcptr x, mpfr_ptr scratch)
+	{
+		Fixed r {};
+		r.neg = mpfr_signbit(x) != 0;
+
+		// top limb first: scale so its bits form the integer part, peel, repeat
+		mpfr_abs(scratch, x, MPFR_RNDZ);
+		mpfr_mul_2si(scratch, scratch, 64 - int_bits, MPFR_RNDZ);
+		for (int k = N - 1; k >= 0; k--)
+		{
+			r.mag[k] = mpfr_get_ui(scratch, MPFR_RNDZ);
+			mpfr_frac(scratch, scratch, MPFR_RNDZ);
+			mpfr_mul_2ui(scratch, scratch, 64, MPFR_RNDZ);
+		}
+		return r;
+	}
+
+	// Top two limbs are plenty for the escape test and colouring
+	double to_double() const
+	{
+		const double v = std::ldexp(double(mag[N - 1]), int_bits - 64) + std::ldexp(double(mag[N - 2]), int_bits - 128);
+		return neg ? -v : v;
+	}
+
+	// Same convention as mpfr_get_exp: |x| in [2^(e-1), 2^e), INT_MIN for zero
+	int exponent() const
+	{
+		for (int k = N - 1; k >= 0; k--)
+			if (mag[k] != 0)
+				return 64 * k + 64 - std::countl_zero(mag[k]) - frac_bits;
+		return std::numeric_limits<int>::min();
+	}
+
+	// Scaled by a pixel index
+	Fixed mul_ui(uint64_t b) const
+	{
+		Fixed r;
+		unsigned __int128 carry = 0;
+		for (int k = 0; k < N; k++)
+		{
+			carry += (unsigned __int128)(mag[k]) * b;
+			r.mag[k] = uint64_t(carry);
+			carry >>= 64;
+		}
+		r.neg = neg;
+		return r;
+	}
+
+	friend Fixed operator+(const Fixed& a, const Fixed& b)
+	{
+		Fixed r;
+		if (a.neg == b.neg) {
+			add_mag(r.mag, a.mag, b.mag);
+			r.neg = a.neg;
+		} else if (less_mag(a.mag, b.mag)) {
+			sub_mag(r.mag, b.mag, a.mag);
+			r.neg = b.neg;
+		} else {
+			sub_mag(r.mag, a.mag, b.mag);
+			r.neg = a.neg;
+		}
+		return r;
+	}
+
+	friend Fixed operator-(const Fixed& a, const Fixed& b)
+	{
+		Fixed nb = b;
+		nb.neg = !nb.neg;
+		return a + nb;
+	}
+
+	friend Fixed operator*(const Fixed& a, const Fixed& b)
+	{
+		uint64_t r[2 * N] = {};
+		for (int i = 0; i < N; i++)
+		{
+			unsigned __int128 carry = 0;
+			for (int j = 0; j < N; j++)
+			{
+				carry += (unsigned __int128)(a.mag[i]) * b.mag[j] + r[i + j];
+				r[i + j] = uint64_t(carry);
+				carry >>= 64;
+			}
+			r[i + N] = uint64_t(carry);
+		}
+
+		Fixed p;
+		narrow(p.mag, r);
+		p.neg = a.neg != b.neg;
+		return p;
+	}
+
+	// Cross products once, doubled, then the diagonal
+	friend Fixed sqr(const Fixed& a)
+	{
+		uint64_t r[2 * N] = {};
+		for (int i = 0; i < N; i++)
+		{
+			unsigned __int128 carry = 0;
+			for (int j = i + 1; j < N; j++)
+			{
+				carry += (unsigned __int128)(a.mag[i]) * a.mag[j] + r[i + j];
+				r[i + j] = uint64_t(carry);
+				carry >>= 64;
+			}
+			r[i + N] = uint64_t(carry);
+		}
+
+		uint64_t top = 0;
+		for (int k = 0; k < 2 * N; k++)
+		{
+			const uint64_t next = r[k] >> 63;
+			r[k] = r[k] << 1 | top;
+			top = next;
+		}
+
+		unsigned __int128 carry = 0;
+		for (int i = 0; i < N; i++)
+		{
+			const unsigned __int128 d = (unsigned __int128)(a.mag[i]) * a.mag[i];
+			carry += uint64_t(d);
+			carry += r[2 * i];
+			r[2 * i] = uint64_t(carry);
+			carry >>= 64;
+			carry += uint64_t(d >> 64);
+			carry += r[2 * i + 1];
+			r[2 * i + 1] = uint64_t(carry);
+			carry >>= 64;
+		}
+
+		Fixed p;
+		narrow(p.mag, r);
+		p.neg = false;
+		return p;
+	}
+
+	// Exact
+	Fixed mul_2() const
+	{
+		Fixed r;
+		for (int k = N - 1; k > 0; k--)
+			r.mag[k] = mag[k] << 1 | mag[k - 1] >> 63;
+		r.mag[0] = mag[0] << 1;
+		r.neg = neg;
+		return r;
+	}
+
+private:
+	// Drops the low frac_bits of a double width product
+	static void narrow(uint64_t (&m)[N], const uint64_t (&r)[2 * N])
+	{
+		for (int k = 0; k < N; k++)
+			m[k] = r[k + N - 1] >> (64 - int_bits) | r[k + N] << int_bits;
+	}
+
+	static void add_mag(uint64_t (&m)[N], const uint64_t (&a)[N], const uint64_t (&b)[N])
+	{
+		unsigned __int128 carry = 0;
+		for (int k = 0; k < N; k++)
+		{
+			carry += (unsigned __int128)(a[k]) + b[k];
+			m[k] = uint64_t(carry);
+			carry >>= 64;
+		}
+	}
+
+	static void sub_mag(uint64_t (&m)[N], const uint64_t (&a)[N], const uint64_t (&b)[N])
+	{
+		uint64_t borrow = 0;
+		for (int k = 0; k < N; k++)
+		{
+			const uint64_t d = a[k] - b[k];
+			m[k] = d - borrow;
+			borrow = (a[k] < b[k]) | (d < borrow);
+		}
+	}
+
+	static bool less_mag(const uint64_t (&a)[N], const uint64_t (&b)[N])
+	{
+		for (int k = N - 1; k >= 0; k--)
+			if (a[k] != b[k])
+				return a[k] < b[k];
+		return false;
+	}
+};
+
+// Limbs needed to hold prec fractional bits, 0 if more than the widest Fixed
+inline int fixed_limbs(mpfr_prec_t prec)
+{
+	const int limbs = std::max(2, int((prec + Fixed<2>::int_bits + 63) / 64));
+	return limbs <= 8 ? limbs : 0;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "fractal-mp/pch.hpp"
+
+// Puts rendered frames out on stdout from a thread of its own, so the workers get on with
+// the next frame meanwhile. submit() trades the caller's finished canvas for a buffer that's
+// free to be drawn into again.
+//
+// Into a pipe the frames are vmspliced, the pipe holds references to the canvas pages rather
+// than a copy of them. A buffer is only free again once the reader has consumed all of it,
+// which is certain when another pipe capacity worth of bytes went in after it. Until then
+// it's retired, and submit() hands out a new buffer if no retired one is free yet. Anything
+// but a pipe gets writev, a buffer is free the moment that returns. Headers, the stream's
+// and every frame's, are small enough to be copied either way
+template<class Buffer>
+class FrameWriter
+{
+	struct Retired {
+		Buffer buffer;
+		uint64_t end;	// pushed when the last of it went in
+	};
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	const size_t size;
+	const std::string stream_header, frame_header;
+	Buffer buffer;
+	std::deque<Retired> retired;
+	bool full = false, finishing = false, failed = false;
+
+	static constexpr int fd = STDOUT_FILENO;
+	bool splice = false;
+	size_t pipe_capacity = 0;
+	// bytes put out so far, guarded by mtx
+	uint64_t pushed = 0;
+
+	std::thread thread;
+
+public:
+	// size is the canvas', every buffer is that size
+	FrameWriter(size_t size, std::string stream_header = {}, std::string frame_header = {})
+		:size(size), stream_header(std::move(stream_header)), frame_header(std::move(frame_header))
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 and S_ISFIFO(st.st_mode)) {
+			const int capacity = fcntl(fd, F_GETPIPE_SZ);
+			splice = capacity > 0;
+			pipe_capacity = std::max(capacity, 0);
+		}
+		spdlog::debug("Frames go out by {}", splice ? "vmsplice" : "writev");
+
+		thread = std::thread(&FrameWriter::workplace, this);
+	}
+
+	~FrameWriter()
+	{
+		finish();
+	}
+
+	// Waits while the frame before is still going out. canvas comes back with
+	// stale pixels, to be overwritten. False once a write has failed. canvas_mtx is
+	// held for the trade alone, when somebody else reads canvas meanwhile
+	bool submit(Buffer& canvas, std::mutex* canvas_mtx = nullptr)
+	{
+		std::unique_lock lk(mtx);
+		cv.wait(lk, [this] { return !full; });
+		if (failed)
+			return false;
+
+		Buffer spare;
+		if (!retired.empty() and pushed - retired.front().end >= pipe_capacity) {
+			spare = std::move(retired.front().buffer);
+			retired.pop_front();
+		} else {
+			spare = Buffer(size);
+		}
+
+		if (canvas_mtx) {
+			std::scoped_lock lg(*canvas_mtx);
+			buffer = std::exchange(canvas, std::move(spare));
+		} else {
+			buffer = std::exchange(canvas, std::move(spare));
+		}
+		full = true;
+		cv.notify_all();
+		return true;
+	}
+
+	// Back when everything submitted is out, and when spliced, read by the other end too.
+	// The buffers can't be freed any earlier
+	bool finish()
+	{
+		if (!thread.joinable())
+			return !failed;
+
+		{
+			std::scoped_lock lg(mtx);
+			finishing = true;
+		}
+		cv.notify_all();
+		thread.join();
+
+		if (splice)
+			drain();
+		return !failed;
+	}
+
+private:
+	// Until the pipe is empty or nobody reads it anymore. Nothing wakes a writer when the
+	// reader takes bytes out, so it looks every 10ms. POLLERR comes without asking for it
+	void drain()
+	{
+		for (int queued; ioctl(fd, FIONREAD, &queued) == 0 and queued > 0;)
+		{
+			pollfd pfd = {.fd = fd, .events = 0};
+			if (poll(&pfd, 1, 0) > 0 and (pfd.revents & POLLERR))
+				break;
+			poll(nullptr, 0, 10);
+		}
+	}
+
+	void workplace()
+	{
+		const bool started = put_copy(stream_header);
+
+		std::unique_lock lk(mtx);
+		failed = !started;
+		pushed += stream_header.size();
+
+		while (true)
+		{
+			cv.wait(lk, [this] { return full or finishing; });
+			if (!full)
+				break;
+
+			lk.unlock();
+			const bool written = put_copy(frame_header)
+				and put(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof buffer[0]);
+			lk.lock();
+
+			pushed += frame_header.size() + buffer.size() * sizeof buffer[0];
+			retired.push_back({std::move(buffer), pushed});
+			failed = failed or !written;
+			full = false;
+			cv.notify_all();
+		}
+	}
+
+	bool put_copy(std::string_view data)
+	{
+		return put_all(iovec {const_cast<char*>(data.data()), data.size()}, true);
+	}
+
+	// Not gifted, the buffer gets drawn into again once it's free. Gifted pages
+	// would be the pipe's to keep
+	bool put(const char* data, size_t length)
+	{
+		return put_all(iovec {const_cast<char*>(data), length});
+	}
+
+	bool put_all(iovec iov, bool copy = false)
+	{
+		while (iov.iov_len != 0)
+		{
+			const ssize_t done = splice and !copy ? vmsplice(fd, &iov, 1, 0) : writev(fd, &iov, 1);
+			if (done < 0) {
+				if (errno == EINTR)
+					continue;
+				// some pipes won't splice, copying still works
+				if (splice and !copy and (errno == EINVAL or errno == ENOSYS)) {
+					spdlog::warn("vmsplice refused, frames go out by writev");
+					splice = false;
+					continue;
+				}
+				return false;
+			}
+
+			iov.iov_base = static_cast<char*>(iov.iov_base) + done;
+			iov.iov_len -= done;
+		}
+		return true;
+	}
+};
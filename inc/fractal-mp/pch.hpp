@@ -1,22 +1,37 @@
 // system headers
+#include <array>
+#include <bit>
+#include <charconv>
 #include <chrono>
+#include <complex>
 #include <condition_variable>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <iostream>
 #include <numeric>
+#include <optional>
 #include <print>
 #include <queue>
 #include <ranges>
-#include <semaphore>
 #include <source_location>
+#include <span>
+#include <stop_token>
 #include <string_view>
 #include <thread>
 #include <unordered_map>
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <linux/input-event-codes.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <xkbcommon/xkbcommon.h>
 
 // external libraries
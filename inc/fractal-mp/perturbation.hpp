@@ -0,0 +1,201 @@
+#pragma once
+
+#include "fractal-mp/pch.hpp"
+
+using dcomplex = std::complex<double>;
+
+// High precision orbit of a single reference point. Every other pixel is
+// iterated in double as a delta against it: z = Z + dz, c = C + dc
+// dz' = 2*Z*dz + dz^2 + dc
+class ReferenceOrbit
+{
+public:
+	std::vector<dcomplex> z;
+
+	void compute(mpfr_srcptr c_re, mpfr_srcptr c_im, unsigned max_iterations, mpfr_prec_t prec, mpfr_rnd_t rnd)
+	{
+		const mpc_rnd_t crnd = MPC_RND(rnd, rnd);
+
+		mpc_t zm, cm;
+		mpfr_t norm, const_4;
+
+		mpc_init2(zm, prec);
+		mpc_init2(cm, prec);
+		mpfr_init2(norm, prec);
+		mpfr_init2(const_4, prec);
+
+		mpfr_set(cm->re, c_re, rnd);
+		mpfr_set(cm->im, c_im, rnd);
+		mpfr_set_zero(zm->re, 1);
+		mpfr_set_zero(zm->im, 1);
+		mpfr_set_ui(const_4, 4, rnd);
+
+		z.clear();
+		z.reserve(max_iterations + 1);
+		z.emplace_back(0, 0);
+
+		// The escaping point is kept too, so a pixel can always take one step
+		// from the last entry before it has to rebase
+		for (unsigned iter = 0; iter < max_iterations; iter++)
+		{
+			mpc_sqr(zm, zm, crnd);
+			mpc_add(zm, zm, cm, crnd);
+
+			z.emplace_back(mpfr_get_d(zm->re, rnd), mpfr_get_d(zm->im, rnd));
+
+			mpc_norm(norm, zm, rnd);
+			if (mpfr_greater_p(norm, const_4) != 0)
+				break;
+		}
+
+		mpfr_clear(const_4);
+		mpfr_clear(norm);
+		mpc_clear(cm);
+		mpc_clear(zm);
+	}
+
+	size_t size() const
+	{
+		return z.size();
+	}
+};
+
+// Bivariate linear approximation of l consecutive steps of the orbit:
+// dz[m+l] = A*dz[m] + B*dc, valid while |dz[m]| < r. Single steps drop the dz^2
+// term, merged ones are composed pairwise into a binary tree (level k spans 2^k
+// steps) starting at m = 1, since Z[0] = 0 makes the first step useless
+class BlaTable
+{
+public:
+	struct Node {
+		dcomplex a, b;
+		double r;
+	};
+
+	static constexpr double epsilon = 0x1p-53;
+
+	std::vector<std::vector<Node>> levels;
+
+	void compute(const ReferenceOrbit& orbit, double dc_max)
+	{
+		levels.clear();
+		if (orbit.size() < 3)
+			return;
+
+		const size_t steps = orbit.size() - 2;
+
+		auto& base = levels.emplace_back(steps);
+		for (size_t i = 0; i < steps; i++)
+		{
+			const dcomplex a = 2. * orbit.z[i + 1];
+			base[i] = {.a = a, .b = 1, .r = epsilon * std::abs(a)};
+		}
+
+		while (levels.back().size() > 1)
+		{
+			const auto& lower = levels.back();
+			std::vector<Node> upper(lower.size() / 2);
+
+			for (size_t i = 0; i < upper.size(); i++)
+			{
+				const auto& x = lower[2 * i];
+				const auto& y = lower[2 * i + 1];
+
+				const double ax = std::abs(x.a);
+				const double ry = ax == 0 ? 0 : (y.r - std::abs(x.b) * dc_max) / ax;
+				upper[i] = {
+					.a = y.a * x.a,
+					.b = y.a * x.b + y.b,
+					.r = std::max(0., std::min(x.r, ry))
+				};
+			}
+
+			levels.push_back(std::move(upper));
+		}
+	}
+
+	// Largest skip usable at orbit index m that keeps iter within budget
+	const Node* lookup(size_t m, double dz_norm, unsigned budget, unsigned& skip) const
+	{
+		if (m == 0)
+			return nullptr;
+
+		const size_t pos = m - 1;
+		for (int level = int(levels.size()) - 1; level >= 0; level--)
+		{
+			const size_t span = size_t(1) << level;
+			if (pos & (span - 1) or span > budget)
+				continue;
+
+			const size_t j = pos >> level;
+			if (j >= levels[level].size())
+				continue;
+
+			const auto& node = levels[level][j];
+			if (dz_norm < node.r * node.r)
+			{
+				skip = span;
+				return &node;
+			}
+		}
+
+		return nullptr;
+	}
+};
+
+// Iterates dc against the orbit. A pixel whose |z| falls below its |dz| is
+// about to glitch (the delta stops being small relative to the orbit), so it
+// gets re-referenced to the start of the orbit with dz = z. Same happens when
+// the reference escaped before the pixel did
+struct PerturbationResult {
+	unsigned iter;
+	unsigned rebases;
+	unsigned skipped;
+};
+
+// Gives up once stopped() says so, asked every check_every steps
+template<class Stopped>
+PerturbationResult perturbation_iterate(const ReferenceOrbit& orbit, const BlaTable* bla, dcomplex dc, unsigned max_iterations,
+	unsigned check_every, Stopped&& stopped)
+{
+	const auto* Z = orbit.z.data();
+	const size_t last = orbit.size() - 1;
+
+	dcomplex dz(0, 0);
+	size_t m = 0;
+
+	PerturbationResult result {};
+	for (unsigned step = 1; result.iter < max_iterations; step++)
+	{
+		unsigned skip = 1;
+		const BlaTable::Node* node = bla ? bla->lookup(m, std::norm(dz), max_iterations - result.iter, skip) : nullptr;
+
+		if (node) {
+			dz = node->a * dz + node->b * dc;
+			result.skipped += skip;
+		} else {
+			dz = (2. * Z[m] + dz) * dz + dc;
+		}
+		m += skip;
+
+		const dcomplex z = Z[m] + dz;
+		const double z_norm = std::norm(z);
+		if (z_norm > 4) {
+			result.iter += skip - 1;
+			break;
+		}
+		result.iter += skip;
+
+		if (z_norm < std::norm(dz) or m == last)
+		{
+			dz = z;
+			m = 0;
+			result.rebases++;
+		}
+
+		if (step % check_every == 0 and stopped())
+			break;
+	}
+
+	return result;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "fractal-mp/pch.hpp"
+
+// BGRA to planar 4:2:0 in BT.601 studio range, what ffmpeg's yuv420p assumes. A chroma
+// sample is the average of its 2x2 pixels, sited at their centre like Y4M's C420jpeg.
+// Plain loops over plain arrays in integers, so they vectorize
+inline size_t yuv420_size(int width, int height)
+{
+	const size_t chroma = size_t((width + 1) / 2) * ((height + 1) / 2);
+	return size_t(width) * height + 2 * chroma;
+}
+
+inline void bgra_to_luma(const uint32_t* src, uint8_t* y, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const int r = (src[i] >> 16) & 0xff, g = (src[i] >> 8) & 0xff, b = src[i] & 0xff;
+		y[i] = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	}
+}
+
+// From two rows, bottom may be top again when the height is odd
+inline void bgra_to_chroma(const uint32_t* top, const uint32_t* bottom, uint8_t* u, uint8_t* v, int width)
+{
+	const int pairs = width / 2;
+	for (int i = 0; i < pairs; i++)
+	{
+		const uint32_t p[4] = {top[2 * i], top[2 * i + 1], bottom[2 * i], bottom[2 * i + 1]};
+		int r = 0, g = 0, b = 0;
+		for (uint32_t q : p) {
+			r += (q >> 16) & 0xff;
+			g += (q >> 8) & 0xff;
+			b += q & 0xff;
+		}
+
+		// sums of four, the extra 2 bits go with the shift
+		u[i] = uint8_t(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+		v[i] = uint8_t(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+	}
+
+	if (width % 2 != 0)
+	{
+		const uint32_t p[2] = {top[width - 1], bottom[width - 1]};
+		int r = 0, g = 0, b = 0;
+		for (uint32_t q : p) {
+			r += (q >> 16) & 0xff;
+			g += (q >> 8) & 0xff;
+			b += q & 0xff;
+		}
+		u[pairs] = uint8_t(((-38 * r - 74 * g + 112 * b + 256) >> 9) + 128);
+		v[pairs] = uint8_t(((112 * r - 94 * g - 18 * b + 256) >> 9) + 128);
+	}
+}
+
+// Rows [row_start, row_end) of the frame, row_start even. yuv is the whole frame,
+// the Y plane then U then V
+inline void bgra_to_yuv420(const uint32_t* canvas, int width, int height, int row_start, int row_end, uint8_t* yuv)
+{
+	const int chroma_width = (width + 1) / 2;
+	uint8_t* const y = yuv;
+	uint8_t* const u = y + size_t(width) * height;
+	uint8_t* const v = u + size_t(chroma_width) * ((height + 1) / 2);
+
+	for (int row = row_start; row < row_end; row += 2)
+	{
+		const uint32_t* top = canvas + size_t(row) * width;
+		const uint32_t* bottom = row + 1 < height ? top + width : top;
+
+		bgra_to_luma(top, y + size_t(row) * width, width);
+		if (row + 1 < height)
+			bgra_to_luma(bottom, y + size_t(row + 1) * width, width);
+		bgra_to_chroma(top, bottom, u + size_t(row / 2) * chroma_width, v + size_t(row / 2) * chroma_width, width);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "fractal/pch.hpp"
+
+// Leaves default constructed elements uninitialised, so a freshly allocated buffer's
+// pages stay untouched until somebody writes them. The first writer decides which
+// NUMA node a page lands on
+template<class T>
+struct FirstTouchAllocator : std::allocator<T>
+{
+	FirstTouchAllocator() = default;
+
+	template<class U>
+	FirstTouchAllocator(const FirstTouchAllocator<U>&) noexcept
+	{
+	}
+
+	// Types the allocation alone brings to life, ddreal and qdreal too despite their
+	// zeroing default constructors, aren't constructed at all
+	template<class U, class... Args>
+	void construct(U* p, Args&&... args)
+	{
+		if constexpr (sizeof...(Args) == 0 and std::is_trivially_copyable_v<U> and std::is_trivially_destructible_v<U>)
+			return;
+		else if constexpr (sizeof...(Args) == 0)
+			::new (static_cast<void*>(p)) U;
+		else
+			::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+	}
+};
+
+template<class T>
+using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
+
+inline bool parse_whole(std::string_view str, int& value)
+{
+	const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+	return ec == std::errc() and end == str.data() + str.size();
+}
+
+// CPU list the way taskset -c takes it, "0-7,16-23". nullopt if it doesn't parse
+inline std::optional<std::vector<int>> parse_cpu_list(std::string_view list)
+{
+	std::vector<int> cpus;
+	while (!list.empty())
+	{
+		const size_t comma = list.find(',');
+		const std::string_view item = list.substr(0, comma);
+		list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+		const size_t dash = item.find('-');
+		const std::string_view first_str = item.substr(0, dash);
+		const std::string_view last_str = dash == std::string_view::npos ? first_str : item.substr(dash + 1);
+
+		int first, last;
+		if (!parse_whole(first_str, first) or !parse_whole(last_str, last) or first < 0 or first > last or last >= CPU_SETSIZE)
+			return std::nullopt;
+
+		for (int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+// The calling thread onto a single CPU, false if the kernel wouldn't have it
+inline bool pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,491 @@
+#pragma once
+
+#include "fractal/pch.hpp"
+
+// Double-double (~106 bits) and quad-double (~212 bits) reals: unevaluated sums
+// of 2 or 4 non-overlapping doubles, after Hida, Li and Bailey's QD library.
+// The error-free transformations only hold with strict IEEE semantics, so fast
+// math is off in here whatever the build says. Everything is branch free so
+// loops over independent lanes can be vectorized
+
+#pragma GCC push_options
+#pragma GCC optimize("no-fast-math")
+
+namespace mdouble
+{
+
+inline double two_sum(double a, double b, double& err)
+{
+	const double s = a + b;
+	const double bb = s - a;
+	err = (a - (s - bb)) + (b - bb);
+	return s;
+}
+
+// |a| >= |b|
+inline double quick_two_sum(double a, double b, double& err)
+{
+	const double s = a + b;
+	err = b - (s - a);
+	return s;
+}
+
+inline double two_prod(double a, double b, double& err)
+{
+	const double p = a * b;
+	err = std::fma(a, b, -p);
+	return p;
+}
+
+inline void three_sum(double& a, double& b, double& c)
+{
+	double t1, t2, t3;
+	t1 = two_sum(a, b, t2);
+	a = two_sum(c, t1, t3);
+	b = two_sum(t2, t3, c);
+}
+
+inline void three_sum2(double& a, double& b, double& c)
+{
+	double t1, t2, t3;
+	t1 = two_sum(a, b, t2);
+	a = two_sum(c, t1, t3);
+	b = t2 + t3;
+}
+
+// Branch free variant of QD's renormalization: one bottom-up and one top-down sweep
+inline void renorm(double& c0, double& c1, double& c2, double& c3, double& c4)
+{
+	double s;
+	s = quick_two_sum(c3, c4, c4);
+	s = quick_two_sum(c2, s, c3);
+	s = quick_two_sum(c1, s, c2);
+	c0 = quick_two_sum(c0, s, c1);
+
+	c1 = two_sum(c1, c2, c2);
+	c2 = two_sum(c2, c3, c3);
+	c3 = c3 + c4;
+}
+
+inline void renorm(double& c0, double& c1, double& c2, double& c3)
+{
+	double c4 = 0;
+	renorm(c0, c1, c2, c3, c4);
+}
+
+}
+
+struct ddreal
+{
+	double hi = 0, lo = 0;
+
+	constexpr ddreal() = default;
+	constexpr ddreal(double hi, double lo) :hi(hi), lo(lo) {}
+	constexpr ddreal(double x) :hi(x) {}
+	template<std::integral I> constexpr ddreal(I x) :hi(double(x)) {}
+	explicit ddreal(long double x) :hi(double(x)), lo(double(x - hi)) {}
+
+	explicit operator float() const { return float(hi); }
+	explicit operator double() const { return hi + lo; }
+	explicit operator long double() const { return (long double)(hi) + lo; }
+};
+
+struct qdreal
+{
+	double x[4] {};
+
+	constexpr qdreal() = default;
+	constexpr qdreal(double x0, double x1, double x2, double x3) :x{x0, x1, x2, x3} {}
+	constexpr qdreal(double x0) :x{x0, 0, 0, 0} {}
+	template<std::integral I> constexpr qdreal(I x) :x{double(x), 0, 0, 0} {}
+	constexpr qdreal(const ddreal& a) :x{a.hi, a.lo, 0, 0} {}
+	explicit qdreal(long double v) :x{double(v), double(v - (long double)(double(v))), 0, 0} {}
+
+	explicit operator float() const { return float(x[0]); }
+	explicit operator double() const { return x[0] + x[1]; }
+	explicit operator long double() const { return (long double)(x[0]) + x[1]; }
+	explicit operator ddreal() const { double e; const double s = mdouble::quick_two_sum(x[0], x[1] + x[2], e); return {s, e}; }
+};
+
+template<>
+struct std::numeric_limits<ddreal> : std::numeric_limits<double>
+{
+	static constexpr int digits = 104;
+	static constexpr int digits10 = 31;
+	static constexpr ddreal epsilon() { return 0x1p-104; }
+};
+
+template<>
+struct std::numeric_limits<qdreal> : std::numeric_limits<double>
+{
+	static constexpr int digits = 209;
+	static constexpr int digits10 = 62;
+	static constexpr qdreal epsilon() { return 0x1p-209; }
+};
+
+/* ddreal arithmetic */
+inline ddreal operator-(const ddreal& a) { return {-a.hi, -a.lo}; }
+
+inline ddreal operator+(const ddreal& a, const ddreal& b)
+{
+	double s1, s2, t1, t2;
+	s1 = mdouble::two_sum(a.hi, b.hi, s2);
+	t1 = mdouble::two_sum(a.lo, b.lo, t2);
+	s2 += t1;
+	s1 = mdouble::quick_two_sum(s1, s2, s2);
+	s2 += t2;
+	s1 = mdouble::quick_two_sum(s1, s2, s2);
+	return {s1, s2};
+}
+
+inline ddreal operator+(const ddreal& a, double b)
+{
+	double s1, s2;
+	s1 = mdouble::two_sum(a.hi, b, s2);
+	s2 += a.lo;
+	s1 = mdouble::quick_two_sum(s1, s2, s2);
+	return {s1, s2};
+}
+
+inline ddreal operator*(const ddreal& a, const ddreal& b)
+{
+	double p1, p2;
+	p1 = mdouble::two_prod(a.hi, b.hi, p2);
+	p2 += a.hi * b.lo + a.lo * b.hi;
+	p1 = mdouble::quick_two_sum(p1, p2, p2);
+	return {p1, p2};
+}
+
+inline ddreal operator*(const ddreal& a, double b)
+{
+	double p1, p2;
+	p1 = mdouble::two_prod(a.hi, b, p2);
+	p2 += a.lo * b;
+	p1 = mdouble::quick_two_sum(p1, p2, p2);
+	return {p1, p2};
+}
+
+inline ddreal sqr(const ddreal& a)
+{
+	double p1, p2;
+	p1 = mdouble::two_prod(a.hi, a.hi, p2);
+	p2 += 2 * a.hi * a.lo;
+	p1 = mdouble::quick_two_sum(p1, p2, p2);
+	return {p1, p2};
+}
+
+inline ddreal operator/(const ddreal& a, const ddreal& b)
+{
+	const double q1 = a.hi / b.hi;
+	ddreal r = a + -(b * q1);
+	const double q2 = r.hi / b.hi;
+	r = r + -(b * q2);
+	const double q3 = r.hi / b.hi;
+
+	double e;
+	const double s = mdouble::quick_two_sum(q1, q2, e);
+	return ddreal(s, e) + q3;
+}
+
+inline ddreal operator+(double a, const ddreal& b) { return b + a; }
+inline ddreal operator-(const ddreal& a, const ddreal& b) { return a + -b; }
+inline ddreal operator-(const ddreal& a, double b) { return a + -b; }
+inline ddreal operator-(double a, const ddreal& b) { return -b + a; }
+inline ddreal operator*(double a, const ddreal& b) { return b * a; }
+inline ddreal operator/(const ddreal& a, double b) { return a / ddreal(b); }
+inline ddreal operator/(double a, const ddreal& b) { return ddreal(a) / b; }
+
+/* qdreal arithmetic */
+inline qdreal operator-(const qdreal& a) { return {-a.x[0], -a.x[1], -a.x[2], -a.x[3]}; }
+
+inline qdreal operator+(const qdreal& a, const qdreal& b)
+{
+	double s0, s1, s2, s3;
+	double t0, t1, t2, t3;
+
+	s0 = mdouble::two_sum(a.x[0], b.x[0], t0);
+	s1 = mdouble::two_sum(a.x[1], b.x[1], t1);
+	s2 = mdouble::two_sum(a.x[2], b.x[2], t2);
+	s3 = mdouble::two_sum(a.x[3], b.x[3], t3);
+
+	s1 = mdouble::two_sum(s1, t0, t0);
+	mdouble::three_sum(s2, t0, t1);
+	mdouble::three_sum2(s3, t0, t2);
+	t0 = t0 + t1 + t3;
+
+	mdouble::renorm(s0, s1, s2, s3, t0);
+	return {s0, s1, s2, s3};
+}
+
+inline qdreal operator+(const qdreal& a, double b)
+{
+	double c0, c1, c2, c3, e;
+	c0 = mdouble::two_sum(a.x[0], b, e);
+	c1 = mdouble::two_sum(a.x[1], e, e);
+	c2 = mdouble::two_sum(a.x[2], e, e);
+	c3 = mdouble::two_sum(a.x[3], e, e);
+
+	mdouble::renorm(c0, c1, c2, c3, e);
+	return {c0, c1, c2, c3};
+}
+
+inline qdreal operator*(const qdreal& a, const qdreal& b)
+{
+	double p0, p1, p2, p3, p4, p5;
+	double q0, q1, q2, q3, q4, q5;
+	double t0, t1;
+	double s0, s1, s2;
+
+	p0 = mdouble::two_prod(a.x[0], b.x[0], q0);
+
+	p1 = mdouble::two_prod(a.x[0], b.x[1], q1);
+	p2 = mdouble::two_prod(a.x[1], b.x[0], q2);
+
+	p3 = mdouble::two_prod(a.x[0], b.x[2], q3);
+	p4 = mdouble::two_prod(a.x[1], b.x[1], q4);
+	p5 = mdouble::two_prod(a.x[2], b.x[0], q5);
+
+	mdouble::three_sum(p1, p2, q0);
+
+	// six-three sum of p2, q1, q2, p3, p4, p5
+	mdouble::three_sum(p2, q1, q2);
+	mdouble::three_sum(p3, p4, p5);
+	s0 = mdouble::two_sum(p2, p3, t0);
+	s1 = mdouble::two_sum(q1, p4, t1);
+	s2 = q2 + p5;
+	s1 = mdouble::two_sum(s1, t0, t0);
+	s2 += (t0 + t1);
+
+	// O(eps^3) terms
+	s1 += a.x[0] * b.x[3] + a.x[1] * b.x[2] + a.x[2] * b.x[1] + a.x[3] * b.x[0] + q0 + q3 + q4 + q5;
+
+	mdouble::renorm(p0, p1, s0, s1, s2);
+	return {p0, p1, s0, s1};
+}
+
+inline qdreal operator*(const qdreal& a, double b)
+{
+	double p0, p1, p2, p3;
+	double q0, q1, q2;
+	double s0, s1, s2, s3, s4;
+
+	p0 = mdouble::two_prod(a.x[0], b, q0);
+	p1 = mdouble::two_prod(a.x[1], b, q1);
+	p2 = mdouble::two_prod(a.x[2], b, q2);
+	p3 = a.x[3] * b;
+
+	s0 = p0;
+	s1 = mdouble::two_sum(q0, p1, s2);
+	mdouble::three_sum(s2, q1, p2);
+	mdouble::three_sum2(q1, q2, p3);
+	s3 = q1;
+	s4 = q2 + p2;
+
+	mdouble::renorm(s0, s1, s2, s3, s4);
+	return {s0, s1, s2, s3};
+}
+
+inline qdreal sqr(const qdreal& a)
+{
+	return a * a;
+}
+
+inline qdreal operator/(const qdreal& a, const qdreal& b)
+{
+	double q0, q1, q2, q3;
+	qdreal r;
+
+	q0 = a.x[0] / b.x[0];
+	r = a + -(b * q0);
+	q1 = r.x[0] / b.x[0];
+	r = r + -(b * q1);
+	q2 = r.x[0] / b.x[0];
+	r = r + -(b * q2);
+	q3 = r.x[0] / b.x[0];
+
+	mdouble::renorm(q0, q1, q2, q3);
+	return {q0, q1, q2, q3};
+}
+
+inline qdreal operator+(double a, const qdreal& b) { return b + a; }
+inline qdreal operator-(const qdreal& a, const qdreal& b) { return a + -b; }
+inline qdreal operator-(const qdreal& a, double b) { return a + -b; }
+inline qdreal operator-(double a, const qdreal& b) { return -b + a; }
+inline qdreal operator*(double a, const qdreal& b) { return b * a; }
+inline qdreal operator/(const qdreal& a, double b) { return a / qdreal(b); }
+inline qdreal operator/(double a, const qdreal& b) { return qdreal(a) / b; }
+
+/* common to both */
+template<class T>
+concept multi_double = std::same_as<T, ddreal> or std::same_as<T, qdreal>;
+
+inline double leading(const ddreal& a) { return a.hi; }
+inline double leading(const qdreal& a) { return a.x[0]; }
+
+template<multi_double T> T& operator+=(T& a, const T& b) { return a = a + b; }
+template<multi_double T> T& operator-=(T& a, const T& b) { return a = a - b; }
+template<multi_double T> T& operator*=(T& a, const T& b) { return a = a * b; }
+template<multi_double T> T& operator/=(T& a, const T& b) { return a = a / b; }
+
+// a - b is exact in its leading component whenever it matters, so it decides
+template<multi_double T> bool operator<(const T& a, const T& b) { return leading(a - b) < 0; }
+template<multi_double T> bool operator>(const T& a, const T& b) { return leading(a - b) > 0; }
+template<multi_double T> bool operator<=(const T& a, const T& b) { return leading(a - b) <= 0; }
+template<multi_double T> bool operator>=(const T& a, const T& b) { return leading(a - b) >= 0; }
+template<multi_double T> bool operator==(const T& a, const T& b) { return leading(a - b) == 0; }
+template<multi_double T> bool operator<(const T& a, double b) { return leading(a - b) < 0; }
+template<multi_double T> bool operator>(const T& a, double b) { return leading(a - b) > 0; }
+template<multi_double T> bool operator<=(const T& a, double b) { return leading(a - b) <= 0; }
+template<multi_double T> bool operator>=(const T& a, double b) { return leading(a - b) >= 0; }
+
+template<multi_double T> T abs(const T& a) { return leading(a) < 0 ? -a : a; }
+
+// Exact for powers of two, no renormalization needed
+inline ddreal mul_pwr2(const ddreal& a, double b) { return {a.hi * b, a.lo * b}; }
+inline qdreal mul_pwr2(const qdreal& a, double b) { return {a.x[0] * b, a.x[1] * b, a.x[2] * b, a.x[3] * b}; }
+
+// Largest integer not above a
+inline ddreal floor(const ddreal& a)
+{
+	const double hi = std::floor(a.hi);
+	if (hi != a.hi)
+		return hi;
+
+	double lo = std::floor(a.lo), e;
+	const double s = mdouble::quick_two_sum(hi, lo, e);
+	return {s, e};
+}
+
+inline qdreal floor(const qdreal& a)
+{
+	double x0 = std::floor(a.x[0]), x1 = 0, x2 = 0, x3 = 0;
+	if (x0 == a.x[0]) {
+		x1 = std::floor(a.x[1]);
+		if (x1 == a.x[1]) {
+			x2 = std::floor(a.x[2]);
+			if (x2 == a.x[2])
+				x3 = std::floor(a.x[3]);
+		}
+	}
+
+	mdouble::renorm(x0, x1, x2, x3);
+	return {x0, x1, x2, x3};
+}
+
+template<multi_double T>
+T pow10(int exponent)
+{
+	T result = 1, base = 10;
+	for (unsigned n = std::abs(exponent); n != 0; n >>= 1, base = base * base)
+		if (n & 1)
+			result = result * base;
+	return exponent < 0 ? T(1) / result : result;
+}
+
+template<multi_double T>
+std::string to_string(T a, int digits = std::numeric_limits<T>::digits10)
+{
+	if (leading(a) == 0)
+		return "0";
+
+	std::string str;
+	if (leading(a) < 0) {
+		str += '-';
+		a = -a;
+	}
+
+	int exponent = std::floor(std::log10(std::abs(leading(a))));
+	a = a * pow10<T>(-exponent);
+	if (a >= 10) {
+		a = a / 10;
+		exponent++;
+	} else if (a < 1) {
+		a = a * 10;
+		exponent--;
+	}
+
+	for (int i = 0; i < digits; i++)
+	{
+		int digit = int(leading(floor(a)));
+		a = a - digit;
+		if (leading(a) < 0) {
+			digit--;
+			a = a + 1;
+		}
+
+		str += char('0' + std::clamp(digit, 0, 9));
+		if (i == 0)
+			str += '.';
+		a = a * 10;
+	}
+
+	return str + std::format("e{}", exponent);
+}
+
+// [-]digits[.digits][e[-]digits]
+template<multi_double T>
+bool from_string(std::string_view str, T& out)
+{
+	T value = 0;
+	bool negative = false, dot = false, any = false;
+	int exponent = 0;
+
+	size_t i = 0;
+	if (i < str.size() and (str[i] == '-' or str[i] == '+'))
+		negative = str[i++] == '-';
+
+	for (; i < str.size(); i++)
+	{
+		const char ch = str[i];
+		if (ch >= '0' and ch <= '9') {
+			value = value * 10 + (ch - '0');
+			exponent -= dot;
+			any = true;
+		} else if (ch == '.' and !dot) {
+			dot = true;
+		} else {
+			break;
+		}
+	}
+
+	if (i < str.size() and (str[i] == 'e' or str[i] == 'E'))
+	{
+		int e = 0;
+		const char* begin = str.data() + i + 1;
+		if (begin != str.data() + str.size() and *begin == '+')
+			begin++;
+
+		const auto [end, ec] = std::from_chars(begin, str.data() + str.size(), e);
+		if (ec != std::errc() or end != str.data() + str.size())
+			return false;
+		exponent += e;
+		i = str.size();
+	}
+
+	if (!any or i != str.size())
+		return false;
+
+	value = value * pow10<T>(exponent);
+	out = negative ? -value : value;
+	return true;
+}
+
+template<multi_double T>
+std::istream& operator>>(std::istream& is, T& a)
+{
+	std::string str;
+	if ((is >> str) and !from_string(str, a))
+		is.setstate(std::ios::failbit);
+	return is;
+}
+
+template<multi_double T>
+struct std::formatter<T> : std::formatter<std::string>
+{
+	auto format(const T& a, auto& ctx) const
+	{
+		return std::formatter<std::string>::format(to_string(a), ctx);
+	}
+};
+
+#pragma GCC pop_options
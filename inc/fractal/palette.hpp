@@ -0,0 +1,64 @@
+#pragma once
+
+#include "fractal/pch.hpp"
+
+// Everything a pixel's colour depends on besides its escape data. Changing it
+// only takes a colouring pass over the buffers, nothing gets iterated again
+struct Palette {
+	float density = 1;	// colour cycles per max_iterations
+	float phase = 0;	// radians, what colour cycling moves
+
+	// The entry colorize_row() works out has to fit an int, at 1024 it's about 4M
+	static constexpr float min_density = 1.f / 64, max_density = 1024;
+
+	bool operator==(const Palette&) const = default;
+};
+
+// Continuous iteration count, n + 1 - log2(log |z|). Interior pixels stay at max_iterations
+inline float smooth_escape(unsigned iter, float norm, unsigned max_iterations)
+{
+	if (iter >= max_iterations)
+		return max_iterations;
+	return iter + 1 - std::log2(std::log(norm) / 2);
+}
+
+// The colour of every phase around the circle, sampled palette_size times
+static constexpr int palette_size = 4096;
+
+inline const std::array<uint32_t, palette_size>& palette_table()
+{
+	static const auto table = [] {
+		std::array<uint32_t, palette_size> table;
+		for (int i = 0; i < palette_size; i++)
+		{
+			const float r = (1 + std::sin(i * 2 * M_PIf / palette_size)) / 2;
+			const float g = (1 + std::sin(r * 2 * M_PIf + M_PIf / 4)) / 2;
+			const float b = (1 + std::cos(g * 2 * M_PIf)) / 2;
+
+			table[i] = uint32_t(std::clamp(r, 0.f, 1.f) * 255) << 16
+				| uint32_t(std::clamp(g, 0.f, 1.f) * 255) << 8
+				| uint32_t(std::clamp(b, 0.f, 1.f) * 255);
+		}
+		return table;
+	}();
+	return table;
+}
+
+// Pixel i at c = (x0 + dx * i, y). The phase is worked out in table entries rather
+// than radians, so a pixel is a multiply-add, a square root and a gather. Kept a flat
+// loop over plain arrays so it vectorizes
+inline void colorize_row(const Palette& palette, unsigned max_iterations, float x0, float dx, float y, const float* smooth, uint32_t* canvas, int count)
+{
+	const auto& table = palette_table();
+	const float per_radian = palette_size / (2 * M_PIf);
+	const float scale = palette.density * palette_size / max_iterations;
+	const float offset = palette.phase * per_radian;
+
+	for (int i = 0; i < count; i++)
+	{
+		const float x = x0 + dx * i;
+		const float abs_c = std::sqrt(x * x + y * y);
+		const int entry = int(smooth[i] * scale + abs_c * per_radian + offset);
+		canvas[i] = table[entry & (palette_size - 1)];
+	}
+}
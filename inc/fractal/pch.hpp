@@ -1,6 +1,11 @@
 // system headers
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
 #include <chrono>
 #include <exception>
+#include <functional>
 #include <print>
 #include <queue>
 #include <source_location>
@@ -9,12 +14,16 @@
 #include <tuple>
 #include <unordered_map>
 #include <ranges>
-#include <semaphore>
 #include <numeric>
+#include <optional>
 #include <complex>
 #include <iostream>
+#include <list>
+#include <span>
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <linux/input-event-codes.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
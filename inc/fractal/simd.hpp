@@ -0,0 +1,437 @@
+#pragma once
+
+#include "fractal/pch.hpp"
+#include "fractal/multi-double.hpp"
+
+// Escape time kernels iterating a whole span of a row at once
+namespace kernel
+{
+
+enum class Isa { scalar, avx2, avx512 };
+
+inline Isa detect_isa()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return Isa::avx512;
+	if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+		return Isa::avx2;
+	return Isa::scalar;
+}
+
+inline std::string_view isa_name(Isa isa)
+{
+	switch (isa) {
+	case Isa::avx512: return "AVX-512";
+	case Isa::avx2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+// Pixel i of the span sits at c = (x0 + dx * i, y0 + dy * i), a row or a column.
+// norms gets |z|^2 of the first z past the bailout, for smooth colouring, and
+// zr, zi where the orbit stopped, so a pixel that ran out of budget can go on later
+template<class T>
+struct Span {
+	T x0, dx, y0, dy;
+	int count;
+	unsigned max_iterations;
+	unsigned* iters;
+	float* norms;
+	T* zr, * zi;
+	const std::atomic<unsigned>* generation;
+	unsigned gen;
+};
+
+// Pixels the budget ran out on, picked up where they stopped. They are scattered
+// over a row, so c comes per pixel, and iters goes in as how far z got. dx, dy
+// are the pixel size the periodicity tolerance is based on
+template<class T>
+struct Resume {
+	const T* cr, * ci;
+	T* zr, * zi;
+	T dx, dy;
+	int count;
+	unsigned max_iterations;
+	unsigned* iters;
+	float* norms;
+	const std::atomic<unsigned>* generation;
+	unsigned gen;
+};
+
+// A span is given up on once *generation moves off gen, looked at every cancel_check
+// iterations. Whatever the kernel left in the span then is garbage, the caller drops it
+static constexpr unsigned cancel_check = 256;
+
+template<template<class> class S, class T>
+bool cancelled(const S<T>& span)
+{
+	return span.generation->load(std::memory_order_relaxed) != span.gen;
+}
+
+// Interior pixels never escape, so they are cut short and reported as never_escapes:
+// the main cardioid and period-2 bulb in closed form, everything else once z revisits
+// (within a fraction of a pixel) the value saved at the last power of two iteration.
+// Unlike max_iterations, a bigger budget won't change that. All the kernels return
+// how many pixels got cut short
+static constexpr unsigned never_escapes = ~0u;
+static constexpr unsigned periodicity_first_check = 8;
+
+template<class T>
+bool in_main_bulbs(const T& x, const T& y)
+{
+	const T xq = x - T(0.25);
+	const T q = xq * xq + y * y;
+	const T xb = x + T(1);
+	return q * (q + xq) <= T(0.25) * y * y or xb * xb + y * y <= T(0.0625);
+}
+
+template<template<class> class S, class T>
+T periodicity_tolerance(const S<T>& span)
+{
+	using std::abs;
+	return std::max(abs(span.dx), abs(span.dy)) * T(1. / 65536);
+}
+
+template<class T>
+unsigned iterate_scalar(const Span<T>& span)
+{
+	const T tolerance = periodicity_tolerance(span);
+	const T tolerance_2 = tolerance * tolerance;
+
+	unsigned interior = 0;
+	for (int i = 0; i < span.count; i++)
+	{
+		const T cr = span.x0 + span.dx * i, ci = span.y0 + span.dy * i;
+
+		if (in_main_bulbs(cr, ci)) {
+			span.iters[i] = never_escapes;
+			span.norms[i] = 0;
+			span.zr[i] = span.zi[i] = 0;
+			interior++;
+			continue;
+		}
+
+		unsigned iter = 0; T zr = 0, zi = 0, norm = 0;
+		T sr = 0, si = 0; unsigned check_at = periodicity_first_check;
+		for (; iter < span.max_iterations; iter++)
+		{
+			const T f_zr = zr * zr - zi * zi + cr;
+			const T f_zi = 2 * zr * zi + ci;
+
+			norm = f_zr * f_zr + f_zi * f_zi;
+			if (norm > 4)
+				break;
+
+			zr = f_zr;
+			zi = f_zi;
+
+			const T dr = zr - sr, di = zi - si;
+			if (dr * dr + di * di < tolerance_2) {
+				iter = never_escapes;
+				interior++;
+				break;
+			}
+
+			if (iter == check_at) {
+				sr = zr;
+				si = zi;
+				check_at *= 2;
+			}
+
+			if (iter % cancel_check == cancel_check - 1 and cancelled(span))
+				return interior;
+		}
+
+		span.iters[i] = iter;
+		span.norms[i] = float(norm);
+		span.zr[i] = zr;
+		span.zi[i] = zi;
+	}
+
+	return interior;
+}
+
+// N lanes per register, K registers in flight to hide the latency of the
+// z -> z^2 + c dependency chain. Escaped lanes are masked out and freeze
+template<class T, int N, int K>
+[[gnu::always_inline]] inline unsigned iterate_lanes(const Span<T>& span)
+{
+	typedef T V __attribute__((vector_size(N * sizeof(T))));
+	using S = std::conditional_t<sizeof(T) == 4, int32_t, int64_t>;
+	typedef S M __attribute__((vector_size(N * sizeof(T))));
+
+	V lane {};
+	for (int l = 0; l < N; l++)
+		lane[l] = l;
+
+	const T tolerance = periodicity_tolerance(span);
+	const T tolerance_2 = tolerance * tolerance;
+
+	unsigned interior_count = 0;
+	for (int base = 0; base < span.count; base += N * K)
+	{
+		V cr[K], ci[K], zr[K], zi[K], sr[K], si[K];
+		M active[K], interior[K], iters[K];
+
+		for (int k = 0; k < K; k++)
+		{
+			const V index = lane + T(base + k * N);
+			cr[k] = span.x0 + span.dx * index;
+			ci[k] = span.y0 + span.dy * index;
+			zr[k] = zi[k] = sr[k] = si[k] = V {};
+			iters[k] = M {};
+			active[k] = index < T(span.count);
+
+			const V xq = cr[k] - T(0.25);
+			const V q = xq * xq + ci[k] * ci[k];
+			const V xb = cr[k] + 1;
+			interior[k] = active[k] & ((q * (q + xq) <= T(0.25) * ci[k] * ci[k]) | (xb * xb + ci[k] * ci[k] <= T(0.0625)));
+			active[k] &= ~interior[k];
+		}
+
+		unsigned check_at = periodicity_first_check;
+		for (unsigned iter = 0; iter < span.max_iterations; iter++)
+		{
+			M any {};
+			for (int k = 0; k < K; k++)
+			{
+				const V f_zr = zr[k] * zr[k] - zi[k] * zi[k] + cr[k];
+				const V f_zi = 2 * zr[k] * zi[k] + ci[k];
+
+				active[k] &= f_zr * f_zr + f_zi * f_zi <= 4;
+				iters[k] -= active[k];
+
+				zr[k] = active[k] ? f_zr : zr[k];
+				zi[k] = active[k] ? f_zi : zi[k];
+
+				const V dr = zr[k] - sr[k], di = zi[k] - si[k];
+				const M periodic = active[k] & (dr * dr + di * di < tolerance_2);
+				interior[k] |= periodic;
+				active[k] &= ~periodic;
+
+				any |= active[k];
+			}
+
+			if (iter == check_at)
+			{
+				for (int k = 0; k < K; k++) {
+					sr[k] = zr[k];
+					si[k] = zi[k];
+				}
+				check_at *= 2;
+			}
+
+			// the horizontal test isn't free, a few wasted iterations are
+			if ((iter & 3) == 3)
+			{
+				bool alive = false;
+				for (int l = 0; l < N; l++)
+					alive |= any[l] != 0;
+				if (!alive)
+					break;
+			}
+
+			if (iter % cancel_check == cancel_check - 1 and cancelled(span))
+				return interior_count;
+		}
+
+		// escaped lanes froze on the last z inside, one more step off the loop gets the norm
+		for (int k = 0; k < K; k++)
+		{
+			const V f_zr = zr[k] * zr[k] - zi[k] * zi[k] + cr[k];
+			const V f_zi = 2 * zr[k] * zi[k] + ci[k];
+			const V norm = f_zr * f_zr + f_zi * f_zi;
+
+			for (int l = 0, i = base + k * N; l < N and i < span.count; l++, i++) {
+				span.iters[i] = interior[k][l] ? never_escapes : iters[k][l];
+				span.norms[i] = float(norm[l]);
+				span.zr[i] = zr[k][l];
+				span.zi[i] = zi[k][l];
+				interior_count += interior[k][l] != 0;
+			}
+		}
+	}
+
+	return interior_count;
+}
+
+#pragma GCC push_options
+#pragma GCC optimize("no-fast-math")
+
+// Same scheme for the multi-double types, K pixels stepped together with
+// branch free selects so the lane loops can vectorize. The escape test only
+// needs the leading components
+template<multi_double T, int K>
+[[gnu::always_inline]] inline unsigned iterate_multi(const Span<T>& span)
+{
+	// the differences are taken in T, only their squares drop to the leading double
+	const double tolerance = leading(periodicity_tolerance(span));
+	const double tolerance_2 = tolerance * tolerance;
+
+	unsigned interior_count = 0;
+	for (int base = 0; base < span.count; base += K)
+	{
+		T cr[K], ci[K], zr[K], zi[K], sr[K], si[K];
+		unsigned iters[K];
+		bool active[K], interior[K];
+
+		for (int k = 0; k < K; k++)
+		{
+			cr[k] = span.x0 + span.dx * (base + k);
+			ci[k] = span.y0 + span.dy * (base + k);
+			zr[k] = zi[k] = sr[k] = si[k] = 0;
+			iters[k] = 0;
+			active[k] = base + k < span.count;
+			interior[k] = active[k] and in_main_bulbs(cr[k], ci[k]);
+			active[k] = active[k] and !interior[k];
+		}
+
+		unsigned check_at = periodicity_first_check;
+		for (unsigned iter = 0; iter < span.max_iterations; iter++)
+		{
+			bool alive = false;
+			for (int k = 0; k < K; k++)
+			{
+				const T f_zr = sqr(zr[k]) - sqr(zi[k]) + cr[k];
+				const T f_zi = mul_pwr2(zr[k] * zi[k], 2) + ci[k];
+
+				const double lr = leading(f_zr), li = leading(f_zi);
+				active[k] = active[k] and lr * lr + li * li <= 4;
+				iters[k] += active[k];
+
+				zr[k] = active[k] ? f_zr : zr[k];
+				zi[k] = active[k] ? f_zi : zi[k];
+
+				const double dr = leading(zr[k] - sr[k]), di = leading(zi[k] - si[k]);
+				const bool periodic = active[k] and dr * dr + di * di < tolerance_2;
+				interior[k] = interior[k] or periodic;
+				active[k] = active[k] and !periodic;
+
+				alive |= active[k];
+			}
+
+			if (!alive)
+				break;
+
+			if (iter % cancel_check == cancel_check - 1 and cancelled(span))
+				return interior_count;
+
+			if (iter == check_at)
+			{
+				for (int k = 0; k < K; k++) {
+					sr[k] = zr[k];
+					si[k] = zi[k];
+				}
+				check_at *= 2;
+			}
+		}
+
+		for (int k = 0; k < K and base + k < span.count; k++) {
+			const double lr = leading(sqr(zr[k]) - sqr(zi[k]) + cr[k]);
+			const double li = leading(mul_pwr2(zr[k] * zi[k], 2) + ci[k]);
+
+			span.iters[base + k] = interior[k] ? never_escapes : iters[k];
+			span.norms[base + k] = float(lr * lr + li * li);
+			span.zr[base + k] = zr[k];
+			span.zi[base + k] = zi[k];
+			interior_count += interior[k];
+		}
+	}
+
+	return interior_count;
+}
+
+inline unsigned iterate_multi(const Span<ddreal>& span) { return iterate_multi<ddreal, 8>(span); }
+inline unsigned iterate_multi(const Span<qdreal>& span) { return iterate_multi<qdreal, 4>(span); }
+[[gnu::target("avx2,fma")]] inline unsigned iterate_multi_avx2(const Span<ddreal>& span) { return iterate_multi<ddreal, 8>(span); }
+[[gnu::target("avx2,fma")]] inline unsigned iterate_multi_avx2(const Span<qdreal>& span) { return iterate_multi<qdreal, 4>(span); }
+[[gnu::target("avx512f")]] inline unsigned iterate_multi_avx512(const Span<ddreal>& span) { return iterate_multi<ddreal, 8>(span); }
+[[gnu::target("avx512f")]] inline unsigned iterate_multi_avx512(const Span<qdreal>& span) { return iterate_multi<qdreal, 8>(span); }
+
+// The scalar loop again, starting from wherever each pixel was left. The periodicity
+// checks are spaced from there, the saved value starting out as the z it resumes from.
+// Few pixels ever get here, so it's one version for every type, kept out of fast-math
+// for the multi-double ones
+template<class T>
+unsigned resume_scalar(const Resume<T>& resume)
+{
+	const T tolerance = periodicity_tolerance(resume);
+	const T tolerance_2 = tolerance * tolerance;
+
+	unsigned interior = 0;
+	for (int i = 0; i < resume.count; i++)
+	{
+		const T cr = resume.cr[i], ci = resume.ci[i];
+		unsigned iter = resume.iters[i]; T zr = resume.zr[i], zi = resume.zi[i], norm = 0;
+		T sr = zr, si = zi; unsigned check_every = periodicity_first_check, check_at = iter + check_every;
+		for (; iter < resume.max_iterations; iter++)
+		{
+			const T f_zr = zr * zr - zi * zi + cr;
+			const T f_zi = 2 * zr * zi + ci;
+
+			norm = f_zr * f_zr + f_zi * f_zi;
+			if (norm > 4)
+				break;
+
+			zr = f_zr;
+			zi = f_zi;
+
+			const T dr = zr - sr, di = zi - si;
+			if (dr * dr + di * di < tolerance_2) {
+				iter = never_escapes;
+				interior++;
+				break;
+			}
+
+			if (iter == check_at) {
+				sr = zr;
+				si = zi;
+				check_every *= 2;
+				check_at += check_every;
+			}
+
+			if (iter % cancel_check == cancel_check - 1 and cancelled(resume))
+				return interior;
+		}
+
+		resume.iters[i] = iter;
+		resume.norms[i] = float(norm);
+		resume.zr[i] = zr;
+		resume.zi[i] = zi;
+	}
+
+	return interior;
+}
+
+#pragma GCC pop_options
+
+[[gnu::target("avx2,fma")]] inline unsigned iterate_avx2(const Span<float>& span) { return iterate_lanes<float, 8, 4>(span); }
+[[gnu::target("avx2,fma")]] inline unsigned iterate_avx2(const Span<double>& span) { return iterate_lanes<double, 4, 4>(span); }
+[[gnu::target("avx512f")]] inline unsigned iterate_avx512(const Span<float>& span) { return iterate_lanes<float, 16, 4>(span); }
+[[gnu::target("avx512f")]] inline unsigned iterate_avx512(const Span<double>& span) { return iterate_lanes<double, 8, 4>(span); }
+
+template<class T>
+unsigned iterate(Isa isa, const Span<T>& span)
+{
+	if constexpr (std::is_same_v<T, float> or std::is_same_v<T, double>)
+	{
+		switch (isa) {
+		case Isa::avx512: return iterate_avx512(span);
+		case Isa::avx2: return iterate_avx2(span);
+		default: break;
+		}
+	}
+	else if constexpr (multi_double<T>)
+	{
+		switch (isa) {
+		case Isa::avx512: return iterate_multi_avx512(span);
+		case Isa::avx2: return iterate_multi_avx2(span);
+		default: return iterate_multi(span);
+		}
+	}
+
+	return iterate_scalar(span);
+}
+
+}
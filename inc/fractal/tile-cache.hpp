@@ -0,0 +1,121 @@
+#pragma once
+
+#include "fractal/pch.hpp"
+
+// Escape data of past views, in tile_size squares of the pixel grid of a zoom level.
+// An entry remembers which part of its tile was on screen, views that only cut into a
+// tile can still be served from it as long as they ask for no more than that.
+// Least recently used tiles go once the memory cap is reached
+class TileCache
+{
+public:
+	static constexpr int tile_size = 64;
+
+	struct Key {
+		int zoom;
+		int64_t tx, ty;
+		unsigned max_iterations;
+		int tier;
+		// Mariani-Silver fills aren't what iterating gives
+		bool subdivide;
+
+		bool operator==(const Key&) const = default;
+	};
+
+	// Tile local, [x0, x1) x [y0, y1)
+	struct Extent {
+		int x0, y0, x1, y1;
+
+		bool contains(const Extent& o) const
+		{
+			return x0 <= o.x0 and y0 <= o.y0 and o.x1 <= x1 and o.y1 <= y1;
+		}
+	};
+
+	struct Tile {
+		Key key;
+		Extent valid;
+		std::array<unsigned, tile_size * tile_size> iters;
+		std::array<float, tile_size * tile_size> smooth, abs_z;
+	};
+
+private:
+	struct KeyHash {
+		size_t operator()(const Key& k) const
+		{
+			size_t h = std::hash<int64_t>()(k.tx);
+			for (size_t v : {size_t(k.ty), size_t(k.zoom), size_t(k.max_iterations), size_t(k.tier), size_t(k.subdivide)})
+				h ^= v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	size_t capacity;
+	std::list<Tile> tiles;
+	std::unordered_map<Key, std::list<Tile>::iterator, KeyHash> index;
+	uint64_t hits = 0, misses = 0;
+
+public:
+	explicit TileCache(size_t bytes)
+		:capacity(std::max<size_t>(1, bytes / sizeof(Tile)))
+	{
+	}
+
+	~TileCache()
+	{
+		spdlog::debug("TileCache: {} hits, {} misses, {} of {} tiles held", hits, misses, tiles.size(), capacity);
+	}
+
+	// The tile if it covers all of the wanted extent, then it's also the most recently used
+	const Tile* find(const Key& key, const Extent& wanted)
+	{
+		const auto it = index.find(key);
+		if (it == index.end() or !it->second->valid.contains(wanted)) {
+			misses++;
+			return nullptr;
+		}
+
+		hits++;
+		tiles.splice(tiles.begin(), tiles, it->second);
+		return &*it->second;
+	}
+
+	// Slot to copy the valid extent in, nullptr when the held one covers it already
+	Tile* store(const Key& key, const Extent& valid)
+	{
+		if (const auto it = index.find(key); it != index.end())
+		{
+			tiles.splice(tiles.begin(), tiles, it->second);
+			if (it->second->valid.contains(valid))
+				return nullptr;
+			it->second->valid = valid;
+			return &*it->second;
+		}
+
+		// recycle the least recently used one instead of allocating
+		if (tiles.size() >= capacity) {
+			index.erase(tiles.back().key);
+			tiles.splice(tiles.begin(), tiles, std::prev(tiles.end()));
+		} else {
+			tiles.emplace_front();
+		}
+
+		Tile& tile = tiles.front();
+		tile.key = key;
+		tile.valid = valid;
+		index.emplace(key, tiles.begin());
+		return &tile;
+	}
+
+	void clear()
+	{
+		index.clear();
+		tiles.clear();
+	}
+
+	// Floor division, tiles left of and above the anchor have negative coordinates
+	static int64_t tile_of(int64_t pixel)
+	{
+		return pixel >= 0 ? pixel / tile_size : -((-pixel + tile_size - 1) / tile_size);
+	}
+};
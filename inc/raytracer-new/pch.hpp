@@ -1,4 +1,7 @@
 // system headers
+#include <array>
+#include <bit>
+#include <charconv>
 #include <chrono>
 #include <exception>
 #include <print>
@@ -9,8 +12,8 @@
 #include <tuple>
 #include <unordered_map>
 #include <ranges>
-#include <semaphore>
 #include <numeric>
+#include <optional>
 
 #include <fcntl.h>
 #include <linux/input-event-codes.h>
@@ -1,2 +1,9 @@
 #pragma once
 
+#include "raytracer-new/pch.hpp"
+
+inline bool parse_whole(std::string_view str, int& value)
+{
+	const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+	return ec == std::errc() and end == str.data() + str.size();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "raytracer-new/pch.hpp"
+
+// Chase-Lev work stealing deque, fixed capacity, after Lê et al. "Correct and Efficient
+// Work-Stealing for Weak Memory Models". The owner pushes and pops at the bottom without
+// contention, any other thread steals from the top with a CAS. Slots are copied a word at
+// a time through relaxed atomics, so a thief racing the owner reads garbage at worst, and
+// throws it away when its CAS fails
+template<class T, size_t Capacity = 1024>
+class WorkDeque
+{
+	static_assert(std::has_single_bit(Capacity));
+	static_assert(std::is_trivially_copyable_v<T> and std::is_default_constructible_v<T>);
+
+	static constexpr size_t words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	alignas(64) std::atomic<int64_t> top = 0;
+	alignas(64) std::atomic<int64_t> bottom = 0;
+	alignas(64) std::array<std::array<std::atomic<uint64_t>, words>, Capacity> slots;
+
+public:
+	// Owner only. False when full
+	bool push(const T& value)
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed);
+		const int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= int64_t(Capacity))
+			return false;
+
+		store(b, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Owner only, last in first out
+	std::optional<T> pop()
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+
+		const T value = load(b);
+		if (t == b)
+		{
+			// the last one, the thieves may be after it too
+			const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			if (!won)
+				return std::nullopt;
+		}
+		return value;
+	}
+
+	// Anyone, first in first out. Can come back empty handed when it loses a race
+	std::optional<T> steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return std::nullopt;
+
+		const T value = load(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return std::nullopt;
+		return value;
+	}
+
+	// Only a hint while the owner is at work
+	bool empty() const
+	{
+		return top.load(std::memory_order_seq_cst) >= bottom.load(std::memory_order_seq_cst);
+	}
+
+private:
+	void store(int64_t i, const T& value)
+	{
+		uint64_t buffer[words] {};
+		std::memcpy(buffer, &value, sizeof(T));
+
+		auto& slot = slots[i & (Capacity - 1)];
+		for (size_t w = 0; w < words; w++)
+			slot[w].store(buffer[w], std::memory_order_relaxed);
+	}
+
+	T load(int64_t i) const
+	{
+		uint64_t buffer[words];
+		const auto& slot = slots[i & (Capacity - 1)];
+		for (size_t w = 0; w < words; w++)
+			buffer[w] = slot[w].load(std::memory_order_relaxed);
+
+		T value;
+		std::memcpy(&value, buffer, sizeof(T));
+		return value;
+	}
+};
@@ -1,45 +1,156 @@
 #include "fractal-mp/app.hpp"
+#include "fractal-mp/perturbation.hpp"
+#include "fractal-mp/fixed-point.hpp"
+#include "fractal-mp/work-deque.hpp"
+#include "fractal-mp/affinity.hpp"
+#include "fractal-mp/frame-writer.hpp"
+#include "fractal-mp/yuv.hpp"
 
 using zreal = mpfr_t;
 using zcomplex = mpc_t;
 using zvec2 = zreal[2];
-static constexpr mpfr_prec_t zprec = 53;
+
+// Working precision follows the zoom: enough bits to tell neighbouring pixels
+// apart plus some for the error the iteration accumulates, in whole limbs
+static constexpr mpfr_prec_t min_zprec = 53;
+static constexpr mpfr_prec_t guard_bits = 32;
 
 static constexpr unsigned work_multiplier = 4;
 
+enum class Engine { direct, perturbation, fixed_point };
+
+std::string_view engine_name(Engine engine)
+{
+	switch (engine) {
+	case Engine::direct: return "direct";
+	case Engine::perturbation: return "perturbation";
+	case Engine::fixed_point: return "fixed point";
+	}
+	return "?";
+}
+
+// Scalar type the direct engine iterates in, cheapest first
+enum class Tier { f64, f80, mp };
+
+std::string_view tier_name(Tier tier)
+{
+	switch (tier) {
+	case Tier::f64: return "double";
+	case Tier::f80: return "long double";
+	case Tier::mp: return "MPFR";
+	}
+	return "?";
+}
+
+// Interior pixels never escape, so they are cut short and reported as max_iterations:
+// the main cardioid and period-2 bulb in closed form, everything else once z revisits
+// (within 2^-periodicity_bits of a pixel) the value saved at the last power of two iteration
+static constexpr unsigned periodicity_first_check = 8;
+static constexpr int periodicity_bits = 16;
+
+// margin keeps pixels near the boundary out when c is only known approximately
+template<class T>
+bool in_main_bulbs(T x, T y, T margin = 0)
+{
+	const T xq = x - T(0.25);
+	const T q = xq * xq + y * y;
+	const T xb = x + 1;
+	return q * (q + xq) + margin <= T(0.25) * y * y or xb * xb + y * y + margin <= T(0.0625);
+}
+
+// Pixels [x0, x1) x [y0, y1)
+struct Rect {
+	int x0, y0, x1, y1;
+};
+
+// Mariani-Silver: only the border of a rect is iterated. A border of one iteration
+// count is filled in, anything else is split in four and the quarters become tasks
+// of their own. Below min_rect_size everything is iterated
+static constexpr int min_rect_size = 8;
+
+// Progressive rendering: a pass iterates one pixel per block of its size and paints the
+// whole block with it, skipping the pixels coarser passes already have. Bands run a pass
+// at a time, the last task of one queues the next, so a coarse block never lands on finer
+// data. A single pass render is just the last one
+static constexpr int progressive_blocks[] = {16, 4, 1};
+static constexpr unsigned progressive_passes = std::size(progressive_blocks);
+
+// Row commands get halved down to this by whoever runs them, the other halves go up for
+// stealing. Cut a whole number of coarsest blocks from the band start, no block straddles two
+static constexpr int tile_rows = progressive_blocks[0];
+
+// Rows a colour conversion command takes on, even so no chroma row is split
+static constexpr int convert_rows = 32;
+
+// A deep pixel alone can take longer than a cancel may, the kernels look at the generation
+// every this many iterations. MPFR ones cost far more than the look, they do every one
+static constexpr unsigned cancel_check = 256;
+
 template<class TBase, class TInShared, class TInPer, class TOut>
 class ThreadManager
 {
 public:
-	enum class CommandType { quit, work };
+	enum class CommandType { quit, work, rect, convert };
 	struct Command {
 		CommandType type;
 		const TInShared* in_shared;
 		const TInPer* in_per;
 		TOut* out;
+		Rect rect;
+		unsigned pass;
+		// stamped by enqueue(), anything from before the current generation is dropped
+		unsigned gen;
 	};
-	static constexpr std::ptrdiff_t semaphore_least_max_value = 64;
 
 private:
 	mpfr_rnd_t def_rnd;
 	mpc_rnd_t def_crnd;
 
 	unsigned nthreads = 0;
+	// worker i runs on cpus[i % size], none pins nothing
+	std::vector<int> cpus;
 
 	std::vector<std::thread> workers;
-	std::vector<uint64_t> work_cumulative;
 
-	std::counting_semaphore<semaphore_least_max_value> launch_semaphore {0};
-	
+	// place() hands every worker placement once, they notice placement_epoch moved
+	std::function<void(unsigned)> placement;
+	std::atomic<unsigned> placement_epoch = 0, placement_left = 0;
+	std::vector<unsigned> placement_seen;
+	std::vector<uint64_t> work_cumulative, stolen_cumulative;
+	// nanoseconds spent on commands, against the wall clock since initialize() it tells
+	// how well the pool keeps its threads fed: efficiency = Σ busy / (nthreads * wall)
+	std::vector<uint64_t> busy_cumulative;
+	std::chrono::steady_clock::time_point started;
+	std::vector<uint64_t> rebases_cumulative;
+	std::vector<uint64_t> skipped_cumulative, iterations_cumulative;
+	std::vector<uint64_t> pixels_cumulative, interior_cumulative, filled_cumulative;
+
+	// Every worker has a deque of its own, what it spawns goes on the bottom of it and
+	// idle workers steal from the top. Commands from the main thread come through the
+	// injection queue. Sleeping workers wait on permits with atomic wait, idle counts the
+	// ones that are about to, so there's never more permits out than sleepers
+	std::atomic<unsigned> permits = 0;
+	std::unique_ptr<WorkDeque<Command>[]> deques;
+	std::atomic<unsigned> idle = 0;
+
 	std::mutex command_queue_mtx;
 	std::queue<Command> command_queue;
 
+	// commands queued anywhere or being run, quits aside. The _any kind of
+	// condition variable so waiting can be cut short by a stop_token
 	std::mutex left_mtx;
-	std::condition_variable left_cv;
-	std::atomic_short left = 0;
-	std::atomic_bool stop = false;
+	std::condition_variable_any left_cv;
+	std::atomic<unsigned> left = 0;
+
+	// Bumped by cancel(), stale work checks it between pixels and the kernels every cancel_check
+	// iterations. cancelled_at is when the last cancel() happened with work in flight, the worker
+	// that drains it logs how long it took
+	std::atomic<unsigned> generation = 0;
+	std::atomic<int64_t> cancelled_at = 0;
+	std::atomic<uint64_t> cancels = 0, cancel_ns_total = 0, cancel_ns_max = 0;
 
 	zreal const_4;
+	mpfr_prec_t zprec = min_zprec;
 	std::unique_ptr<zcomplex[]> zs, cs;
 	std::vector<std::array<zreal,1>> temps_v;
 	std::vector<std::array<zcomplex,1>> ctemps_v;
@@ -50,12 +161,31 @@ public:
 	{
 		iassert(nthreads != 0);
 		iassert(work_multiplier != 0);
-		iassert(nthreads * work_multiplier < semaphore_least_max_value);
 	}
 
-	void initialize()
+	// threads of 0 keeps the constructor's count, or takes one per CPU given
+	void initialize(unsigned threads = 0, std::vector<int> cpu_list = {})
 	{
+		if (threads != 0)
+			nthreads = threads;
+		else if (!cpu_list.empty())
+			nthreads = cpu_list.size();
+		cpus = std::move(cpu_list);
+		iassert(nthreads != 0);
+
+		spdlog::info("{} workers{}", nthreads, cpus.empty() ? ", unpinned" : "");
+		placement_seen.resize(nthreads, 0);
+		deques = std::make_unique<WorkDeque<Command>[]>(nthreads);
 		work_cumulative.resize(nthreads, 0);
+		stolen_cumulative.resize(nthreads, 0);
+		busy_cumulative.resize(nthreads, 0);
+		started = std::chrono::steady_clock::now();
+		rebases_cumulative.resize(nthreads, 0);
+		skipped_cumulative.resize(nthreads, 0);
+		iterations_cumulative.resize(nthreads, 0);
+		pixels_cumulative.resize(nthreads, 0);
+		interior_cumulative.resize(nthreads, 0);
+		filled_cumulative.resize(nthreads, 0);
 
 		def_rnd = mpfr_get_default_rounding_mode();
 		def_crnd = MPC_RND(def_rnd, def_rnd);
@@ -73,7 +203,7 @@ public:
 			mpc_init2(cs[i], zprec);
 
 			for (auto& temp : temps_v[i])
-				mpfr_init(temp);
+				mpfr_init2(temp, zprec);
 			for (auto& ctemp : ctemps_v[i])
 				mpc_init2(ctemp, zprec);
 
@@ -81,16 +211,50 @@ public:
 		}
 	}
 
-	void launch(std::ptrdiff_t update = 1)
+	// Only while no work is in flight, the values are lost
+	void set_precision(mpfr_prec_t prec)
 	{
-		left = update;
-		launch_semaphore.release(update);
+		if (prec == zprec)
+			return;
+		zprec = prec;
+
+		for (unsigned i : std::views::iota(0u, nthreads)) {
+			mpc_set_prec(zs[i], zprec);
+			mpc_set_prec(cs[i], zprec);
+
+			for (auto& temp : temps_v[i])
+				mpfr_set_prec(temp, zprec);
+			for (auto& ctemp : ctemps_v[i])
+				mpc_set_prec(ctemp, zprec);
+		}
+	}
+
+	// Wakes up to update sleeping workers, the ones awake find the work on their own
+	void launch(unsigned update = 1)
+	{
+		// the work has to be out before idle is looked at, sleep() does it the other way round
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		unsigned sleeping = idle;
+		unsigned woken;
+		do {
+			woken = std::min(update, sleeping);
+			if (woken == 0)
+				return;
+		} while (!idle.compare_exchange_weak(sleeping, sleeping - woken));
+
+		permits += woken;
+		if (woken == 1)
+			permits.notify_one();
+		else
+			permits.notify_all();
 	}
 
 	void enqueue(Command&& cmd, unsigned count = 1)
 	{
+		cmd.gen = generation;
 		const Command& cmd_cref = cmd;
 		std::scoped_lock lg(command_queue_mtx);
+		left += count;
 		for (unsigned _ : std::views::iota(0u, count)) {
 			command_queue.push(cmd_cref);
 		}
@@ -101,25 +265,130 @@ public:
 	{
 		std::scoped_lock lg(command_queue_mtx);
 		for (auto it = begin; it != end; it++) {
-			command_queue.push(*it);
+			Command cmd = *it;
+			cmd.gen = generation;
+			left++;
+			command_queue.push(cmd);
 		}
 	}
 
 	template<class Func>
 	void enqueue(Func setter)
 	{
+		std::queue<Command> fresh;
+		setter(fresh);
+
 		std::scoped_lock lg(command_queue_mtx);
-		setter(command_queue);
+		left += fresh.size();
+		for (; !fresh.empty(); fresh.pop()) {
+			Command cmd = fresh.front();
+			cmd.gen = generation;
+			command_queue.push(cmd);
+		}
 	}
 
-	void halt()
+	// Makes everything queued or running stale without waiting for it, workers drop it
+	// on sight and give up on what they're at by the next pixel
+	void cancel()
 	{
+		if (left != 0)
+		{
+			int64_t none = 0;
+			cancelled_at.compare_exchange_strong(none, std::chrono::steady_clock::now().time_since_epoch().count());
+		}
+		generation++;
 		clear();
-		if (is_done())
-			return;
-		stop = true;
+	}
+
+	// Stale work still running counts in left too
+	void halt()
+	{
+		cancel();
 		wait();
-		stop = false;
+	}
+
+	bool stale(const Command& cmd) const
+	{
+		return cmd.gen != generation.load(std::memory_order_relaxed);
+	}
+
+	static Command band_command(const TInShared* in, TOut* out, const TInPer& band, unsigned pass)
+	{
+		const bool last = pass + 1 == in->passes;
+		return {
+			.type = last and in->subdivide ? CommandType::rect : CommandType::work,
+			.in_shared = in,
+			.in_per = &band,
+			.out = out,
+			.rect = {0, band.row_start, in->width, band.row_end + 1},
+			.pass = pass,
+		};
+	}
+
+	// From worker id, more work for the current launch onto its own deque. Refused when
+	// stale or when the deque is full, the caller then does it itself
+	bool spawn(unsigned id, const Command& cmd)
+	{
+		if (stale(cmd))
+			return false;
+
+		// the caller's own task keeps pass_left and left above zero meanwhile
+		cmd.out->pass_left++;
+		left++;
+		if (!deques[id].push(cmd)) {
+			cmd.out->pass_left--;
+			left--;
+			return false;
+		}
+
+		launch();
+		return true;
+	}
+
+	// From worker id finishing the last task of a pass, unless stale
+	void chain(unsigned id, const Command& cmd)
+	{
+		const auto& bands = cmd.in_shared->bands;
+		cmd.out->pass_left = bands.size();
+		if (stale(cmd))
+			return;
+
+		left += bands.size();
+		for (const auto& band : bands)
+		{
+			Command next = band_command(cmd.in_shared, cmd.out, band, cmd.pass + 1);
+			next.gen = cmd.gen;
+			if (!deques[id].push(next)) {
+				std::scoped_lock lg(command_queue_mtx);
+				command_queue.push(next);
+			}
+		}
+		launch(bands.size());
+	}
+
+	// From worker id finishing the last pass of a frame that goes out as YUV, unless stale.
+	// The conversion is one more pass, over convert_rows at a time
+	void chain_convert(unsigned id, const Command& cmd)
+	{
+		const int width = cmd.in_shared->width, height = cmd.in_shared->height;
+		const unsigned count = (height + convert_rows - 1) / convert_rows;
+		cmd.out->pass_left = count;
+		if (stale(cmd))
+			return;
+
+		left += count;
+		for (int row = 0; row < height; row += convert_rows)
+		{
+			Command next = cmd;
+			next.type = CommandType::convert;
+			next.in_per = nullptr;
+			next.rect = {0, row, width, std::min(row + convert_rows, height)};
+			if (!deques[id].push(next)) {
+				std::scoped_lock lg(command_queue_mtx);
+				command_queue.push(next);
+			}
+		}
+		launch(count);
 	}
 
 	void wait()
@@ -128,6 +397,20 @@ public:
 		left_cv.wait(lg, [this](){ return left == 0; });
 	}
 
+	// Like wait(), false if stop was requested first
+	bool wait(std::stop_token stop)
+	{
+		return wait(stop, [this](){ return left == 0; });
+	}
+
+	// Until done() holds, looked at whenever left drops to zero or a frame completes
+	template<class Pred>
+	bool wait(std::stop_token stop, Pred&& done)
+	{
+		std::unique_lock lg(left_mtx);
+		return left_cv.wait(lg, stop, std::forward<Pred>(done));
+	}
+
 	bool is_done() const
 	{
 		return left == 0;
@@ -138,6 +421,21 @@ public:
 		return nthreads;
 	}
 
+	// func(id) once on every worker, back when all of them are done. Only while done.
+	// Memory a worker writes first gets its pages from that worker's NUMA node
+	template<class Func>
+	void place(Func&& func)
+	{
+		placement = std::forward<Func>(func);
+		placement_left = nthreads;
+		placement_epoch++;
+		launch(nthreads);
+
+		for (unsigned remaining; (remaining = placement_left) != 0;)
+			placement_left.wait(remaining);
+		placement = nullptr;
+	}
+
 	void destroy() // DO NOT FORGET TO CALL!
 	{
 		if (work_cumulative.size() == 0) return;
@@ -145,17 +443,15 @@ public:
 		Command cmd_quit = {.type = CommandType::quit};
 
 		// Filling in the command queues
+		cancel();
 		{
 			std::scoped_lock lg(command_queue_mtx);
-			while (!command_queue.empty())
-				command_queue.pop();
 			for (unsigned _ : std::views::iota(0u, nthreads))
 				command_queue.push(cmd_quit);
 		}
 
 		// Signalling
-		stop = true;
-		launch_semaphore.release(nthreads);
+		launch(nthreads);
 
 		// Waiting
 		std::println(stderr, "Waiting for {} threads to quit...", nthreads);
@@ -164,6 +460,13 @@ public:
 
 		// Statistics
 		const auto total_work_cumulative = std::accumulate(work_cumulative.begin(), work_cumulative.end(), 0);
+		const auto total_stolen = std::accumulate(stolen_cumulative.begin(), stolen_cumulative.end(), uint64_t(0));
+		const auto total_rebases = std::accumulate(rebases_cumulative.begin(), rebases_cumulative.end(), uint64_t(0));
+		const auto total_skipped = std::accumulate(skipped_cumulative.begin(), skipped_cumulative.end(), uint64_t(0));
+		const auto total_iterations = std::accumulate(iterations_cumulative.begin(), iterations_cumulative.end(), uint64_t(0));
+		const auto total_pixels = std::accumulate(pixels_cumulative.begin(), pixels_cumulative.end(), uint64_t(0));
+		const auto total_interior = std::accumulate(interior_cumulative.begin(), interior_cumulative.end(), uint64_t(0));
+		const auto total_filled = std::accumulate(filled_cumulative.begin(), filled_cumulative.end(), uint64_t(0));
 		const double ideal_dist = 1 / double(nthreads);
 
 		std::ostringstream oss;
@@ -175,6 +478,19 @@ public:
 			const auto delta = dist - ideal_dist;
 			oss << delta * 100 << "%, ";
 		}
+		oss << "\n  Σ (stolen) = " << total_stolen;
+		const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+		const double busy = std::accumulate(busy_cumulative.begin(), busy_cumulative.end(), uint64_t(0)) * 1e-9;
+		oss << "\n  Σ (busy) = " << busy << "s over " << wall << "s wall on " << nthreads << " threads";
+		oss << ", busy threads on average = " << busy / wall << ", efficiency = " << busy / (wall * nthreads) * 100 << "%";
+		oss << "\n  Σ (perturbation rebases) = " << total_rebases;
+		oss << "\n  Σ (BLA skipped iterations) = " << total_skipped << " of " << total_iterations;
+		if (total_iterations != 0)
+			oss << " (" << total_skipped * 100. / total_iterations << "%)";
+		oss << "\n  Σ (interior early-outs) = " << total_interior << " of " << total_pixels << " pixels";
+		oss << "\n  Σ (Mariani-Silver filled) = " << total_filled << " pixels";
+		if (cancels != 0)
+			oss << "\n  Cancellation latency = " << cancel_ns_total / cancels / 1e3 << "us average, " << cancel_ns_max / 1e3 << "us max over " << cancels;
 		std::println(stderr, "{}", oss.str());
 
 		// Free MP variables
@@ -192,115 +508,657 @@ public:
 	}
 
 private:
+	// What's queued, the deques get robbed like any thief would
 	void clear()
 	{
-		std::scoped_lock lg(command_queue_mtx);
-		while (!command_queue.empty())
-			command_queue.pop();
+		unsigned removed = 0;
+		{
+			std::scoped_lock lg(command_queue_mtx);
+			removed += command_queue.size();
+			while (!command_queue.empty())
+				command_queue.pop();
+		}
+
+		for (unsigned i : std::views::iota(0u, nthreads))
+			while (!deques[i].empty())
+				if (deques[i].steal())
+					removed++;
+
+		if (removed != 0)
+			left_ritual(removed);
+	}
+
+	void left_ritual(unsigned done = 1)
+	{
+		std::unique_lock lg(left_mtx);
+		iassert(left >= done)
+
+		left -= done;
+		if (left == 0) {
+			drained();
+			left_cv.notify_all();
+		}
+	}
+
+	// Through the mutex so a waiter between checking and sleeping doesn't miss it
+	void complete(TOut& out)
+	{
+		{
+			std::scoped_lock lg(left_mtx);
+			out.complete = true;
+		}
+		left_cv.notify_all();
+	}
+
+	void drained()
+	{
+		const int64_t at = cancelled_at.exchange(0);
+		if (at == 0)
+			return;
+
+		const uint64_t ns = std::chrono::steady_clock::now().time_since_epoch().count() - at;
+		cancels++;
+		cancel_ns_total += ns;
+		if (ns > cancel_ns_max)
+			cancel_ns_max = ns;
+	}
+
+	// Own deque first, newest first while it's still in cache, then the injection
+	// queue, then the oldest, biggest piece of somebody else's
+	std::optional<Command> find(unsigned id)
+	{
+		if (auto cmd = deques[id].pop())
+			return cmd;
+
+		{
+			std::scoped_lock lg(command_queue_mtx);
+			if (!command_queue.empty()) {
+				const Command cmd = command_queue.front();
+				command_queue.pop();
+				return cmd;
+			}
+		}
+
+		for (unsigned k = 1; k < nthreads; k++)
+			if (auto cmd = deques[(id + k) % nthreads].steal()) {
+				stolen_cumulative[id]++;
+				return cmd;
+			}
+		return std::nullopt;
+	}
+
+	// Something may have turned up between find() and idle going up, a launcher that saw
+	// idle up has a permit on its way though, take that or the claim back
+	void sleep(unsigned id)
+	{
+		idle++;
+
+		if (has_work(id))
+		{
+			unsigned sleeping = idle;
+			while (sleeping != 0 and !idle.compare_exchange_weak(sleeping, sleeping - 1));
+			if (sleeping != 0)
+				return;
+		}
+
+		// Permits go to whoever's first, one that did its part of a placement would take
+		// those meant for the ones still to do theirs. It waits the placement out instead
+		for (unsigned left; placement_seen[id] == placement_epoch and (left = placement_left) != 0;)
+			placement_left.wait(left);
+
+		// a permit, the counter is waited on directly
+		for (unsigned available = permits;;)
+		{
+			if (available == 0) {
+				permits.wait(0);
+				available = permits;
+			} else if (permits.compare_exchange_weak(available, available - 1)) {
+				return;
+			}
+		}
+	}
+
+	bool has_work(unsigned id)
+	{
+		if (placement_seen[id] != placement_epoch)
+			return true;
+
+		{
+			std::scoped_lock lg(command_queue_mtx);
+			if (!command_queue.empty())
+				return true;
+		}
+
+		for (unsigned i : std::views::iota(0u, nthreads))
+			if (!deques[i].empty())
+				return true;
+		return false;
+	}
+
+	void run_placement(unsigned id)
+	{
+		const unsigned epoch = placement_epoch;
+		if (placement_seen[id] == epoch)
+			return;
+
+		placement_seen[id] = epoch;
+		placement(id);
+		if (--placement_left == 0)
+			placement_left.notify_all();
+	}
+
+	// Row commands from their band, halved while taller than tile_rows
+	static void split(unsigned id, ThreadManager* mgr, Command& cmd)
+	{
+		if (cmd.type != CommandType::work)
+			return;
+
+		while (cmd.rect.y1 - cmd.rect.y0 > tile_rows)
+		{
+			const int half = (cmd.rect.y1 - cmd.rect.y0) / 2;
+			const int cut = cmd.rect.y0 + (half + tile_rows - 1) / tile_rows * tile_rows;
+
+			Command far = cmd;
+			far.rect.y0 = cut;
+			if (!mgr->spawn(id, far))
+				break;
+			cmd.rect.y1 = cut;
+		}
+	}
+
+	static void workplace(unsigned id, ThreadManager* mgr)
+	{
+		mpfr_set_default_prec(min_zprec);
+		mpfr_set_default_rounding_mode(mgr->def_rnd);
+
+		if (!mgr->cpus.empty() and !pin_to_cpu(mgr->cpus[id % mgr->cpus.size()]))
+			spdlog::warn("Worker {} couldn't be pinned to CPU {}", id, mgr->cpus[id % mgr->cpus.size()]);
+
+		while (true)
+		{
+			mgr->run_placement(id);
+
+			const std::optional<Command> found = mgr->find(id);
+			if (!found) {
+				mgr->sleep(id);
+				continue;
+			}
+			Command cmd = *found;
+
+			// spdlog::debug("{}: Commanded {}", id, cmd.type == CommandType::quit ? "quit" : "work");
+
+			// Quit
+			if (cmd.type == CommandType::quit)
+				break;
+
+			// Work, unless stale, then it's dropped
+			if (!mgr->stale(cmd))
+			{
+				const auto begin = std::chrono::steady_clock::now();
+				split(id, mgr, cmd);
+
+				if (cmd.type == CommandType::convert) {
+					convert(cmd);
+				} else {
+					with_kernel(id, mgr, cmd, [&](auto&& kernel) {
+						if (cmd.type == CommandType::rect)
+							subdivide(id, mgr, cmd, kernel, cmd.rect);
+						else
+							work(id, mgr, cmd, kernel);
+					});
+				}
+
+				// the last task of a pass, spawned ones included
+				if (--cmd.out->pass_left == 0) {
+					if (cmd.pass + 1 < cmd.in_shared->passes)
+						mgr->chain(id, cmd);
+					else if (cmd.type != CommandType::convert and cmd.in_shared->yuv420)
+						mgr->chain_convert(id, cmd);
+					else if (!mgr->stale(cmd))
+						mgr->complete(*cmd.out);
+				}
+
+				mgr->work_cumulative[id]++;
+				mgr->busy_cumulative[id] += std::chrono::nanoseconds(std::chrono::steady_clock::now() - begin).count();
+			}
+
+			mgr->left_ritual();
+		}
+
+		mpfr_free_cache();
+	}
+
+	// Picks the kernel for the engine and tier. The fixed point one wide enough for the
+	// working precision, MPFR past 8 limbs
+	template<class Func>
+	static void with_kernel(unsigned id, ThreadManager* mgr, const Command& cmd, Func&& func)
+	{
+		const auto& in = *cmd.in_shared;
+		if (in.engine == Engine::perturbation) {
+			func(PerturbationKernel(id, mgr, cmd));
+			return;
+		}
+
+		switch (in.tier) {
+		case Tier::f64: func(NativeKernel<double>(mgr, cmd)); return;
+		case Tier::f80: func(NativeKernel<long double>(mgr, cmd)); return;
+		case Tier::mp: break;
+		}
+
+		if (in.engine == Engine::fixed_point) {
+			switch (fixed_limbs(mgr->zprec)) {
+			case 2: func(FixedKernel<2>(id, mgr, cmd)); return;
+			case 3: func(FixedKernel<3>(id, mgr, cmd)); return;
+			case 4: func(FixedKernel<4>(id, mgr, cmd)); return;
+			case 5: func(FixedKernel<5>(id, mgr, cmd)); return;
+			case 6: func(FixedKernel<6>(id, mgr, cmd)); return;
+			case 7: func(FixedKernel<7>(id, mgr, cmd)); return;
+			case 8: func(FixedKernel<8>(id, mgr, cmd)); return;
+			default: break;
+			}
+		}
+
+		func(MpKernel(id, mgr, cmd));
+	}
+
+	template<class Kernel>
+	static void work(unsigned id, ThreadManager* mgr, const Command& cmd, Kernel& kernel)
+	{
+		const auto& in = *cmd.in_shared;
+		const unsigned level = progressive_passes - in.passes + cmd.pass;
+		const int block = progressive_blocks[level];
+		const int coarser = cmd.pass == 0 ? 0 : progressive_blocks[level - 1];
+		// tiles start a whole number of coarsest blocks into their band
+		const int row_start = cmd.rect.y0, row_end = cmd.rect.y1 - 1;
+
+		for (int row = row_start; row <= row_end; row += block)
+		{
+			const bool coarser_row = coarser != 0 and (row - row_start) % coarser == 0;
+
+			kernel.row(row);
+			for (int col = 0; col < in.width and !mgr->stale(cmd); col += block)
+			{
+				if (!coarser_row or col % coarser != 0)
+					iterate_pixel(id, mgr, cmd, kernel, col, row);
+				if (block > 1 and !mgr->stale(cmd))
+					fill_block(cmd, col, row, block, row_end);
+			}
+
+			if (mgr->stale(cmd)) break;
+		}
+	}
+
+	static void convert(const Command& cmd)
+	{
+		const auto& in = *cmd.in_shared;
+		bgra_to_yuv420(cmd.out->canvas.data(), in.width, in.height, cmd.rect.y0, cmd.rect.y1, cmd.out->yuv.data());
 	}
 
-private:
-	static void workplace(unsigned id, ThreadManager* mgr)
+	// Paints the block below and right of (col, row) with its colour, clipped to the band
+	static void fill_block(const Command& cmd, int col, int row, int block, int row_end)
+	{
+		const int width = cmd.in_shared->width;
+		auto& canvas = cmd.out->canvas;
+
+		const uint32_t color = canvas[at(col, row, width)];
+		const int col_end = std::min(col + block, width);
+		for (int r = row; r <= std::min(row + block - 1, row_end); r++)
+			std::fill(canvas.begin() + at(col, r, width), canvas.begin() + at(col_end, r, width), color);
+	}
+
+	template<class Kernel>
+	static void subdivide(unsigned id, ThreadManager* mgr, const Command& cmd, Kernel& kernel, const Rect& rect)
+	{
+		const int w = rect.x1 - rect.x0, h = rect.y1 - rect.y0;
+		if (w <= 0 or h <= 0 or mgr->stale(cmd))
+			return;
+
+		if (!cmd.in_shared->subdivide or w <= min_rect_size or h <= min_rect_size)
+		{
+			for (int row = rect.y0; row < rect.y1 and !mgr->stale(cmd); row++) {
+				kernel.row(row);
+				for (int col = rect.x0; col < rect.x1 and !mgr->stale(cmd); col++)
+					iterate_pixel(id, mgr, cmd, kernel, col, row);
+			}
+			return;
+		}
+
+		// top and bottom rows first, then the columns between them
+		bool uniform = true;
+		unsigned first = 0;
+		for (int row : {rect.y0, rect.y1 - 1}) {
+			kernel.row(row);
+			for (int col = rect.x0; col < rect.x1 and !mgr->stale(cmd); col++) {
+				const unsigned iter = iterate_pixel(id, mgr, cmd, kernel, col, row);
+				if (row == rect.y0 and col == rect.x0)
+					first = iter;
+				uniform = uniform and iter == first;
+			}
+		}
+		for (int row = rect.y0 + 1; row < rect.y1 - 1 and !mgr->stale(cmd); row++) {
+			kernel.row(row);
+			for (int col : {rect.x0, rect.x1 - 1})
+				uniform = iterate_pixel(id, mgr, cmd, kernel, col, row) == first and uniform;
+		}
+		if (mgr->stale(cmd))
+			return;
+
+		// Escaped borders fill too, the colour is the whole count and the pixel's own |c|,
+		// which the fill works out for every pixel the same as iterating would
+		const Rect inner = {rect.x0 + 1, rect.y0 + 1, rect.x1 - 1, rect.y1 - 1};
+		if (uniform)
+		{
+			for (int row = inner.y0; row < inner.y1; row++)
+				for (int col = inner.x0; col < inner.x1; col++)
+					set_pixel(cmd, col, row, first, abs_c(*cmd.in_shared, col, row));
+			mgr->filled_cumulative[id] += size_t(inner.x1 - inner.x0) * (inner.y1 - inner.y0);
+			return;
+		}
+
+		const int mx = (inner.x0 + inner.x1) / 2, my = (inner.y0 + inner.y1) / 2;
+		for (const Rect& quarter : {
+			Rect {inner.x0, inner.y0, mx, my}, Rect {mx, inner.y0, inner.x1, my},
+			Rect {inner.x0, my, mx, inner.y1}, Rect {mx, my, inner.x1, inner.y1}
+		}) {
+			Command sub = cmd;
+			sub.rect = quarter;
+			if (!mgr->spawn(id, sub))
+				subdivide(id, mgr, cmd, kernel, quarter);
+		}
+	}
+
+	// kernel.row(row) must have been called. A kernel that gave up on a stale frame
+	// leaves a made up count, it isn't written anywhere
+	template<class Kernel>
+	static unsigned iterate_pixel(unsigned id, ThreadManager* mgr, const Command& cmd, Kernel& kernel, int col, int row)
+	{
+		const auto [iter, abs_c, interior] = kernel.pixel(col);
+		if (mgr->stale(cmd))
+			return iter;
+		mgr->interior_cumulative[id] += interior;
+		mgr->pixels_cumulative[id]++;
+		// a row is rarely shared by more than two workers, the add stays uncontended
+		cmd.out->row_cost[row].fetch_add(interior ? 1 : iter + 1, std::memory_order_relaxed);
+
+		set_pixel(cmd, col, row, iter, abs_c);
+		return iter;
+	}
+
+	// The phase iter / max_iterations * 2 pi + |c| in table entries
+	static void set_pixel(const Command& cmd, int col, int row, unsigned iter, float abs_c)
+	{
+		const auto index = at(col, row, cmd.in_shared->width);
+		const float entry = iter * (palette_size / float(cmd.in_shared->max_iterations)) + abs_c * (palette_size / (2 * M_PIf));
+
+		cmd.out->iters[index] = iter;
+		cmd.out->canvas[index] = palette()[int(entry) & (palette_size - 1)];
+	}
+
+	// The colour of every phase around the circle, sampled palette_size times
+	static constexpr int palette_size = 4096;
+
+	static const std::array<uint32_t, palette_size>& palette()
+	{
+		static const auto table = [] {
+			std::array<uint32_t, palette_size> table;
+			for (int i = 0; i < palette_size; i++)
+			{
+				glm::vec3 color {};
+
+				color.r = 1 + glm::sin(i * 2 * M_PIf / palette_size);
+				color.r /= 2;
+				color.g = 1 + glm::sin(color.r * 2 * M_PIf + M_PIf / 4);
+				color.g /= 2;
+				color.b = 1 + glm::cos(color.r * 2 * M_PIf);
+				color.b /= 2;
+
+				table[i] = color_u32(color);
+			}
+			return table;
+		}();
+		return table;
+	}
+
+	// For pixels that were never iterated, float is all the colouring needs
+	static float abs_c(const TInShared& in, int col, int row)
+	{
+		return std::hypot(
+			float(in.start_ld[0] + in.delta_ld[0] * col),
+			float(in.start_ld[1] + in.delta_ld[1] * (in.height - row - 1)));
+	}
+
+private: /* kernels: escape iteration and |c| of a pixel, set up row by row */
+	struct Pixel {
+		unsigned iter;
+		float abs_c;
+		bool interior = false;
+	};
+
+	template<class T>
+	struct NativeKernel
+	{
+		using complex = std::complex<T>;
+
+		const ThreadManager* mgr;
+		const Command& cmd;
+		const TInShared& in;
+		const T start_x, delta_x;
+		T y {};
+
+		NativeKernel(const ThreadManager* mgr, const Command& cmd)
+			:mgr(mgr), cmd(cmd), in(*cmd.in_shared), start_x(in.start_ld[0]), delta_x(in.delta_ld[0])
+		{}
+
+		void row(int row)
+		{
+			y = T(in.start_ld[1]) + T(in.delta_ld[1]) * (in.height - row - 1);
+		}
+
+		Pixel pixel(int col)
+		{
+			const complex c(start_x + delta_x * col, y);
+			if (in_main_bulbs(c.real(), c.imag()))
+				return {in.max_iterations, float(std::abs(c)), true};
+
+			const T tolerance = std::ldexp(std::abs(delta_x), -periodicity_bits);
+
+			unsigned iter = 0; complex z(0, 0);
+			complex saved(0, 0); unsigned check_at = periodicity_first_check;
+			for (; iter < in.max_iterations; iter++)
+			{
+				auto f_z = z*z + c;
+
+				if (std::norm(f_z) > 4)
+					break;
+
+				z = f_z;
+
+				if (std::norm(z - saved) < tolerance * tolerance)
+					return {in.max_iterations, float(std::abs(c)), true};
+				if (iter == check_at) {
+					saved = z;
+					check_at *= 2;
+				}
+
+				if (iter % cancel_check == cancel_check - 1 and mgr->stale(cmd))
+					break;
+			}
+
+			return {iter, float(std::abs(c))};
+		}
+	};
+
+	struct MpKernel
 	{
-		mpfr_set_default_prec(zprec);
-		mpfr_set_default_rounding_mode(mgr->def_rnd);
-
-		auto left_ritual = [&]()
+		ThreadManager* mgr;
+		const Command& cmd;
+		const TInShared& in;
+		mpc_ptr z, c, saved;
+		mpfr_ptr temp;
+		mpfr_exp_t tolerance_exp;
+
+		MpKernel(unsigned id, ThreadManager* mgr, const Command& cmd)
+			:mgr(mgr), cmd(cmd), in(*cmd.in_shared), z(mgr->zs[id]), c(mgr->cs[id]), saved(mgr->ctemps_v[id][0]), temp(mgr->temps_v[id][0]),
+			tolerance_exp(mpfr_get_exp(in.delta[0]) - periodicity_bits)
+		{}
+
+		// |a - b| < 2^tolerance_exp, leaves temp clobbered
+		bool close(mpfr_srcptr a, mpfr_srcptr b)
 		{
-			std::unique_lock lg(mgr->left_mtx);
-			iassert(mgr->left > 0)
+			mpfr_sub(temp, a, b, mgr->def_rnd);
+			return mpfr_zero_p(temp) or mpfr_get_exp(temp) <= tolerance_exp;
+		}
 
-			mgr->left--;
-			if (mgr->left == 0)
-				mgr->left_cv.notify_all();
-		};
+		void row(int row)
+		{
+			mpfr_mul_ui(c->im, in.delta[1], in.height - row - 1, mgr->def_rnd);
+			mpfr_add(c->im, in.start[1], c->im, mgr->def_rnd);
+		}
 
-		while (true)
+		Pixel pixel(int col)
 		{
-			Command cmd;
+			mpfr_mul_ui(c->re, in.delta[0], col, mgr->def_rnd);
+			mpfr_add(c->re, in.start[0], c->re, mgr->def_rnd);
 
-			mgr->launch_semaphore.acquire();
-			{
-				std::scoped_lock sl(mgr->command_queue_mtx);
-				if (mgr->command_queue.empty()) {
-					left_ritual();
-					continue;
-				}
+			mpc_abs(temp, c, mgr->def_rnd);
+			const float abs_c = mpfr_get_flt(temp, mgr->def_rnd);
 
-				cmd = mgr->command_queue.front();
-				mgr->command_queue.pop();
-			}
+			// c only enters in double here, the margin covers for it
+			if (in_main_bulbs(mpfr_get_d(c->re, mgr->def_rnd), mpfr_get_d(c->im, mgr->def_rnd), 0x1p-40))
+				return {in.max_iterations, abs_c, true};
 
-			// spdlog::debug("{}: Commanded {}", id, cmd.type == CommandType::quit ? "quit" : "work");
+			mpfr_set_zero(z->re, 1);
+			mpfr_set_zero(z->im, 1);
+			mpfr_set_zero(saved->re, 1);
+			mpfr_set_zero(saved->im, 1);
 
-			// Quit
-			if (cmd.type == CommandType::quit)
-				break;
+			unsigned iter = 0, check_at = periodicity_first_check;
+			for (; iter < in.max_iterations; iter++)
+			{
+				mpc_sqr(z, z, mgr->def_crnd);
+				mpc_add(z, z, c, mgr->def_crnd);
 
-			// Work
-			auto& z = mgr->zs[id];
-			auto& c = mgr->cs[id];
-			auto& temps = mgr->temps_v[id];
-			[[maybe_unused]] auto& ctemps = mgr->ctemps_v[id];
+				mpc_norm(temp, z, mgr->def_rnd);
+				if (mpfr_greater_p(temp, mgr->const_4) != 0)
+					break;
 
-			const int width = cmd.in_shared->width, height = cmd.in_shared->height;
-			const auto at_begin = at(0, cmd.in_per->row_start, width);
+				if (close(z->re, saved->re) and close(z->im, saved->im))
+					return {in.max_iterations, abs_c, true};
+				if (iter == check_at) {
+					mpc_set(saved, z, mgr->def_crnd);
+					check_at *= 2;
+				}
 
-			auto index = at_begin;
-			for (int row = cmd.in_per->row_start; row <= cmd.in_per->row_end; row++)
-			{
-				mpfr_mul_ui(c->im, cmd.in_shared->delta[1], height - row - 1, mgr->def_rnd);
-				mpfr_add(c->im, cmd.in_shared->start[1], c->im, mgr->def_rnd);
+				if (mgr->stale(cmd))
+					break;
+			}
 
-				for (int col = 0; col < width; col++, index++)
-				{
-					mpfr_mul_ui(c->re, cmd.in_shared->delta[0], col, mgr->def_rnd);
-					mpfr_add(c->re, cmd.in_shared->start[0], c->re, mgr->def_rnd);
+			return {iter, abs_c};
+		}
+	};
 
-					mpfr_set_zero(z->re, 1);
-					mpfr_set_zero(z->im, 1);
+	template<int N>
+	struct FixedKernel
+	{
+		using fixed = Fixed<N>;
 
-					unsigned iter = 0;
-					for (; iter < cmd.in_shared->max_iterations; iter++)
-					{
-						mpc_sqr(z, z, mgr->def_crnd);
-						mpc_add(z, z, c, mgr->def_crnd);
+		const ThreadManager* mgr;
+		const Command& cmd;
+		const TInShared& in;
+		fixed start[2], delta[2];
+		fixed y;
+		int tolerance_exp;
 
-						mpc_norm(temps[0], z, mgr->def_rnd);
-						if (mpfr_greater_p(temps[0], mgr->const_4) != 0)
-							break;
-					}
+		FixedKernel(unsigned id, ThreadManager* mgr, const Command& cmd)
+			:mgr(mgr), cmd(cmd), in(*cmd.in_shared)
+		{
+			mpfr_ptr scratch = mgr->temps_v[id][0];
+			for (int i : {0, 1}) {
+				start[i] = fixed::from_mpfr(in.start[i], scratch);
+				delta[i] = fixed::from_mpfr(in.delta[i], scratch);
+			}
+			tolerance_exp = delta[0].exponent() - periodicity_bits;
+		}
+
+		void row(int row)
+		{
+			y = start[1] + delta[1].mul_ui(in.height - row - 1);
+		}
 
-					glm::vec3 color {};
+		Pixel pixel(int col)
+		{
+			const fixed x = start[0] + delta[0].mul_ui(col);
+			const float abs_c = std::hypot(x.to_double(), y.to_double());
 
-					const float iter_ratio = iter / float(cmd.in_shared->max_iterations);
+			if (in_main_bulbs(x.to_double(), y.to_double(), 0x1p-40))
+				return {in.max_iterations, abs_c, true};
 
-					mpc_abs(temps[0], c, mgr->def_rnd);
-					const float abs_c = mpfr_get_flt(temps[0], mgr->def_rnd);
+			unsigned iter = 0, check_at = periodicity_first_check;
+			fixed zr = fixed::zero(), zi = fixed::zero();
+			fixed sr = fixed::zero(), si = fixed::zero();
+			for (; iter < in.max_iterations; iter++)
+			{
+				const fixed f_zr = sqr(zr) - sqr(zi) + x;
+				const fixed f_zi = (zr * zi).mul_2() + y;
 
-					/* mpc_abs(temps[0], z, mgr->def_rnd);
-					const float abs_z = mpfr_get_flt(temps[0], mgr->def_rnd); */
+				const double re = f_zr.to_double(), im = f_zi.to_double();
+				if (re * re + im * im > 4)
+					break;
 
-					color.r = 1 + glm::sin(iter_ratio * 2 * M_PIf + abs_c);
-					color.r /= 2;
-					color.g = 1 + glm::sin(color.r * 2 * M_PIf + M_PIf / 4);
-					color.g /= 2;
-					color.b = 1 + glm::cos(color.r * 2 * M_PIf);
-					color.b /= 2;
+				zr = f_zr;
+				zi = f_zi;
 
-					cmd.out->canvas[index] = color_u32(color);
+				if ((zr - sr).exponent() <= tolerance_exp and (zi - si).exponent() <= tolerance_exp)
+					return {in.max_iterations, abs_c, true};
+				if (iter == check_at) {
+					sr = zr;
+					si = zi;
+					check_at *= 2;
 				}
 
-				if (mgr->stop) break;
+				if (iter % cancel_check == cancel_check - 1 and mgr->stale(cmd))
+					break;
 			}
 
-			left_ritual();
+			return {iter, abs_c};
+		}
+	};
 
-			mgr->work_cumulative[id]++;
+	struct PerturbationKernel
+	{
+		unsigned id;
+		ThreadManager* mgr;
+		const Command& cmd;
+		const TInShared& in;
+		const BlaTable* bla;
+		double dc_im = 0;
+
+		PerturbationKernel(unsigned id, ThreadManager* mgr, const Command& cmd)
+			:id(id), mgr(mgr), cmd(cmd), in(*cmd.in_shared), bla(in.use_bla ? &in.bla : nullptr)
+		{}
+
+		void row(int row)
+		{
+			dc_im = in.ref_offset[1] + in.delta_d[1] * (in.height - row - 1);
 		}
 
-		mpfr_free_cache();
-	}
+		Pixel pixel(int col)
+		{
+			const dcomplex dc(in.ref_offset[0] + in.delta_d[0] * col, dc_im);
+			const dcomplex c = in.ref_center_d + dc;
+
+			if (in_main_bulbs(c.real(), c.imag(), 0x1p-40))
+				return {in.max_iterations, float(std::abs(c)), true};
+
+			const auto result = perturbation_iterate(in.orbit, bla, dc, in.max_iterations, cancel_check,
+				[this] { return mgr->stale(cmd); });
+			mgr->rebases_cumulative[id] += result.rebases;
+			mgr->skipped_cumulative[id] += result.skipped;
+			mgr->iterations_cumulative[id] += result.iter;
+
+			return {result.iter, float(std::abs(c))};
+		}
+	};
 
 	static uint32_t color_u32(glm::vec3 color)
 	{
@@ -320,22 +1178,56 @@ private:
 
 class Fractal : public App
 {
+	struct InPer {
+		int row_start, row_end;
+	};
 	struct InShared {
 		int width, height;
 		zvec2 center, range;
 		zvec2 start, delta;
 		unsigned max_iterations;
+
+		// direct engine, native tiers get start and delta rounded
+		Tier tier;
+		long double start_ld[2], delta_ld[2];
+
+		// perturbation: pixel = center + ref_offset + delta_d * (col, row)
+		Engine engine;
+		ReferenceOrbit orbit;
+		BlaTable bla;
+		bool use_bla;
+		double ref_offset[2], delta_d[2];
+		dcomplex ref_center_d;
+
+		bool subdivide;
+		unsigned passes;
+		std::span<const InPer> bands;
+		// the workers convert the finished canvas into yuv too
+		bool yuv420;
 	};
-	struct InPer {
-		int row_start, row_end;
-	};
+	// workers first touch the rows of their bands, see first_touch()
 	struct Out {
-		std::vector<uint32_t> canvas;
+		FirstTouchVector<uint32_t> canvas;
+		FirstTouchVector<unsigned> iters;
+		// 4:2:0 planes of the canvas, only sized for Y4M output
+		FirstTouchVector<uint8_t> yuv;
+		// iterations spent on every row since the last launch, what rebalance() cuts by
+		std::vector<std::atomic<uint64_t>> row_cost;
+		std::atomic<unsigned> pass_left;
+		std::atomic_bool complete;
+	};
+	// A frame of its own for rendering several at once
+	struct RenderSlot {
+		InShared in {};
+		std::vector<InPer> bands;
+		Out out;
 	};
 
 	InShared in_shared {};
 	std::vector<InPer> in_per;
 	Out out;
+	// draw() reads out.canvas while a render trades it with the writer
+	std::mutex canvas_mtx;
 
 	ThreadManager<Fractal, InShared, InPer, Out> thread_manager;
 
@@ -360,13 +1252,22 @@ class Fractal : public App
 		double zoom = 0;
 		bool no_correct_aspect = false;
 		bool silent = false;
+		bool perturbation = false;
+		bool no_bla = false;
+		bool fixed_point = false;
+		bool mariani_silver = false;
+		int threads = 0;
+		std::string cpus {};
+		int frames_in_flight = 1;
+		std::string output_format = "bgra";
+		bool bench = false;
 
 		struct {
 			std::string_view str;
 			std::string_view str_desc;
 			ArgType type;
 			void* ptr;
-		} const desc[12] {
+		} const desc[21] {
 			{"--help", "b: Self explanatory", ArgType::boolean, &help},
 			{"--render", "b: Outputs raw frames to stdout once initiated", ArgType::boolean, &render},
 			{"--initial-iterations", "i: Initial max iterations", ArgType::integer, &initial_iterations},
@@ -379,12 +1280,23 @@ class Fractal : public App
 			{"--zoom", "d: Zoom", ArgType::dreal, &zoom},
 			{"--no-correct-range", "b: Do not correct the range by the aspect ratio", ArgType::boolean, &no_correct_aspect},
 			{"--silent", "b: Don't utter anything while rendering", ArgType::boolean, &silent},
+			{"--perturbation", "b: Iterate pixels in double against one MPFR reference orbit", ArgType::boolean, &perturbation},
+			{"--no-bla", "b: Do not skip iterations with bilinear approximation while perturbing", ArgType::boolean, &no_bla},
+			{"--fixed-point", "b: Iterate in multi-limb fixed point instead of MPFR once past long double", ArgType::boolean, &fixed_point},
+			{"--mariani-silver", "b: Only iterate rectangle borders, filling in those of a single iteration count", ArgType::boolean, &mariani_silver},
+			{"--threads", "i: Worker threads, one per CPU given or per hardware thread by default", ArgType::integer, &threads},
+			{"--cpus", "s: CPUs to pin the workers onto in order, taskset style like 0-7,16-23", ArgType::string, &cpus},
+			{"--frames-in-flight", "i: Frames rendered at once, still written out in order", ArgType::integer, &frames_in_flight},
+			{"--output-format", "s: What --render writes, raw bgra frames or y4m in 4:2:0", ArgType::string, &output_format},
+			{"--bench", "b: Times a frame on 1, 2, 4... workers up to --threads without a window. --start-center, --start-range and --initial-iterations pick the view", ArgType::boolean, &bench},
 		};
 		const size_t desc_size = sizeof(desc) / sizeof(*desc);
 
 		struct {
 			zvec2 start_center {}, start_range {};
 			zvec2 final_center {};
+			std::vector<int> cpus;
+			bool y4m = false;
 		} refined;
 	} args;
 
@@ -394,6 +1306,13 @@ class Fractal : public App
 	zvec2 center {}, range {};
 	zvec2 start {}, delta {};
 	double max_iterations;
+	mpfr_prec_t zprec = min_zprec;
+	Engine engine = Engine::direct;
+	bool subdivide = false;
+	bool progressive = true;
+	std::optional<Tier> last_tier;
+	// refresh() only cancels, the restart happens once per update() when the workers are done
+	bool restart_pending = false;
 
 	// Rendering specific
 	std::atomic_bool is_rendering = false;
@@ -405,7 +1324,7 @@ public:
 	Fractal()
 	{
 		def_rnd = mpfr_get_default_rounding_mode();
-		mpfr_set_default_prec(zprec);
+		mpfr_set_default_prec(min_zprec);
 
 		alloc_zvec(temps);
 
@@ -426,6 +1345,45 @@ public:
 		alloc_zvec(delta_range);
 	}
 
+	bool benching() const
+	{
+		return args.bench;
+	}
+
+	// Workers the pool gets out of --threads and --cpus
+	unsigned pool_size() const
+	{
+		if (args.threads != 0)
+			return args.threads;
+		if (!args.refined.cpus.empty())
+			return args.refined.cpus.size();
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	// In place of initialize(), there's no window. The seahorse valley at the window's
+	// default size unless the view was given
+	void initialize_bench(unsigned threads)
+	{
+		args.threads = threads;
+		initialize_pre();
+
+		set_zvec(center, args.start_center.empty() ? "-0.743643887037158704752191506114774,0.131825904205311970493132056385139" : args.start_center);
+		set_zvec(range, args.start_range.empty() ? "1e-10,1e-10" : args.start_range);
+		max_iterations = args.initial_iterations > 0 ? args.initial_iterations : 3000;
+		correct_by_aspect();
+		recalculate_start();
+		recalculate_delta();
+	}
+
+	// Seconds from the restart to the frame done
+	double bench_frame()
+	{
+		const auto begin = std::chrono::steady_clock::now();
+		refresh(true);
+		thread_manager.wait();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
 	~Fractal()
 	{
 		if (is_rendering) {
@@ -461,8 +1419,13 @@ private:
 	void initialize_pre() override
 	{
 		title = "Fractal-MP";
+		if (args.perturbation)
+			engine = Engine::perturbation;
+		else if (args.fixed_point)
+			engine = Engine::fixed_point;
+		subdivide = args.mariani_silver;
 		initialize_variables();
-		thread_manager.initialize();
+		thread_manager.initialize(args.threads, args.refined.cpus);
 	}
 
 	void setup_pre() override
@@ -500,18 +1463,47 @@ private:
 		mpfr_mul_d(vec[1], vec[0], inv_ar, def_rnd);
 	}
 
+	// Parameter changes between two updates make one restart, the UI never waits for the
+	// workers to drop the old frame. Except on resize, the buffers can't wait
 	void refresh(bool resize = false)
 	{
-		thread_manager.halt();
+		if (resize) {
+			thread_manager.halt();
+			restart_pending = false;
+			restart(true);
+			return;
+		}
+
+		thread_manager.cancel();
+		restart_pending = true;
+	}
+
+	void flush_restart()
+	{
+		if (restart_pending and thread_manager.is_done()) {
+			restart_pending = false;
+			restart(false);
+		}
+	}
 
+	// Workers must be done, by halt() or by waiting for is_done()
+	void restart(bool resize)
+	{
 		if (resize) {
 			in_shared.width = width;
 			in_shared.height = height;
-			out.canvas.resize(width * height);
+			// new allocations rather than resizes, nothing gets copied over and touched here
+			out.canvas = decltype(out.canvas)(width * height);
+			out.iters = decltype(out.iters)(width * height);
+			out.row_cost = decltype(out.row_cost)(height);
+			out.yuv = decltype(out.yuv)(args.refined.y4m ? yuv420_size(width, height) : 0);
 		}
 		reassign_dynamic();
 		if (resize) {
 			distribute();
+			first_touch();
+		} else if (is_rendering) {
+			rebalance(in_per, out);
 		}
 
 		launch();
@@ -519,16 +1511,129 @@ private:
 
 	void reassign_dynamic()
 	{
-		mpfr_set(in_shared.start[0], start[0], def_rnd);
-		mpfr_set(in_shared.start[1], start[1], def_rnd);
-		mpfr_set(in_shared.delta[0], delta[0], def_rnd);
-		mpfr_set(in_shared.delta[1], delta[1], def_rnd);
+		reassign_dynamic(in_shared);
+	}
+
+	// Only update_precision() needs the workers halted, the rest touches in alone
+	void reassign_dynamic(InShared& in)
+	{
+		update_precision();
+		for (auto* vec : {&in.center, &in.range, &in.start, &in.delta})
+			for (auto& elem : *vec)
+				if (mpfr_get_prec(elem) != zprec)
+					mpfr_set_prec(elem, zprec);
+
+		mpfr_set(in.start[0], start[0], def_rnd);
+		mpfr_set(in.start[1], start[1], def_rnd);
+		mpfr_set(in.delta[0], delta[0], def_rnd);
+		mpfr_set(in.delta[1], delta[1], def_rnd);
+
+		mpfr_set(in.center[0], center[0], def_rnd);
+		mpfr_set(in.center[1], center[1], def_rnd);
+		mpfr_set(in.range[0], range[0], def_rnd);
+		mpfr_set(in.range[1], range[1], def_rnd);
+		in.max_iterations = max_iterations;
+
+		for (int i : {0, 1}) {
+			in.start_ld[i] = mpfr_get_ld(start[i], def_rnd);
+			in.delta_ld[i] = mpfr_get_ld(delta[i], def_rnd);
+		}
+
+		const Tier tier = pick_tier(in);
+		if (tier != last_tier)
+			spdlog::info("Precision tier: {}", tier_name(tier));
+		in.tier = *(last_tier = tier);
+
+		in.subdivide = subdivide;
+		// a render only wants finished frames
+		in.passes = progressive and !is_rendering ? progressive_passes : 1;
+		in.engine = engine;
+		in.yuv420 = is_rendering and args.refined.y4m;
+		if (engine == Engine::perturbation)
+			recalculate_orbit(in);
+	}
+
+	// Workers are halted here, so their variables can be resized in place
+	void update_precision()
+	{
+		const mpfr_prec_t prec = required_precision();
+		if (prec == zprec)
+			return;
+
+		spdlog::debug("MPFR precision: {} -> {} bits", zprec, prec);
+		zprec = prec;
+
+		// The view itself only ever gains bits, the center must survive zooming back out
+		const bool grown = grow_zvec(center, zprec) | grow_zvec(range, zprec) | grow_zvec(start, zprec) | grow_zvec(delta, zprec);
+		if (grown) {
+			recalculate_start();
+			recalculate_delta();
+		}
+		grow_zvec(temps, zprec);
+
+		thread_manager.set_precision(zprec);
+	}
+
+	// depends on start, range and delta
+	mpfr_prec_t required_precision()
+	{
+		mpfr_exp_t top = 1;
+		for (int i : {0, 1}) {
+			mpfr_add(temps[i], start[i], range[i], def_rnd);
+			for (mpfr_srcptr x : {mpfr_srcptr(start[i]), mpfr_srcptr(temps[i])})
+				if (!mpfr_zero_p(x))
+					top = std::max(top, mpfr_get_exp(x));
+		}
+		const mpfr_exp_t bottom = std::min(mpfr_get_exp(delta[0]), mpfr_get_exp(delta[1]));
+
+		const mpfr_prec_t bits = std::max<mpfr_prec_t>(min_zprec, top - bottom + guard_bits);
+		return (bits + mp_bits_per_limb - 1) / mp_bits_per_limb * mp_bits_per_limb;
+	}
+
+	// Cheapest scalar type that still resolves delta anywhere in the view, with a few bits to spare
+	Tier pick_tier(const InShared& in)
+	{
+		long double magnitude = 0;
+		for (int i : {0, 1}) {
+			mpfr_add(temps[i], start[i], range[i], def_rnd);
+			magnitude = std::max({magnitude, std::abs(in.start_ld[i]), std::abs(mpfr_get_ld(temps[i], def_rnd))});
+		}
+		const long double resolution = std::min(in.delta_ld[0], in.delta_ld[1]);
+
+		auto resolves = [&]<class T>(T) {
+			return std::numeric_limits<T>::epsilon() * magnitude * 8 < resolution;
+		};
+
+		if (resolves(double()))
+			return Tier::f64;
+		if (resolves((long double)(0)))
+			return Tier::f80;
+		return Tier::mp;
+	}
+
+	// depends on start, delta, center and max_iterations
+	void recalculate_orbit(InShared& in)
+	{
+		in.orbit.compute(center[0], center[1], max_iterations, zprec, def_rnd);
 
-		mpfr_set(in_shared.center[0], center[0], def_rnd);
-		mpfr_set(in_shared.center[1], center[1], def_rnd);
-		mpfr_set(in_shared.range[0], range[0], def_rnd);
-		mpfr_set(in_shared.range[1], range[1], def_rnd);
-		in_shared.max_iterations = max_iterations;
+		for (int i : {0, 1}) {
+			mpfr_sub(temps[i], start[i], center[i], def_rnd);
+			in.ref_offset[i] = mpfr_get_d(temps[i], def_rnd);
+			in.delta_d[i] = mpfr_get_d(delta[i], def_rnd);
+		}
+		in.ref_center_d = dcomplex(mpfr_get_d(center[0], def_rnd), mpfr_get_d(center[1], def_rnd));
+
+		in.use_bla = !args.no_bla;
+		if (in.use_bla)
+		{
+			// largest |dc| is at one of the corners
+			double dc_max[2];
+			for (int i : {0, 1}) {
+				const double span = in.delta_d[i] * (i == 0 ? width : height);
+				dc_max[i] = std::max(std::abs(in.ref_offset[i]), std::abs(in.ref_offset[i] + span));
+			}
+			in.bla.compute(in.orbit, std::hypot(dc_max[0], dc_max[1]));
+		}
 	}
 
 	// depends on range and center
@@ -576,20 +1681,77 @@ private:
 		}
 	}
 
+	// Frames of a render cost about the same row by row as the one before, so the bands are
+	// cut to equal shares of its iterations rather than of the height. Left alone when there's
+	// nothing to go by, the first frame keeps distribute()'s equal heights.
+	// split() still halves a band into tiles that can be stolen, stealing is what keeps the
+	// tail down to one tile. The cut only has every worker start on about its share, so less
+	// of the frame changes hands. It doesn't follow first_touch(), which runs on resizes alone
+	void rebalance(std::vector<InPer>& bands, const Out& last)
+	{
+		uint64_t total = 0;
+		for (const auto& cost : last.row_cost)
+			total += cost.load(std::memory_order_relaxed);
+		if (total == 0)
+			return;
+
+		const unsigned count = std::min<unsigned>(thread_manager.num_threads() * work_multiplier, height);
+		bands.resize(count, {});
+
+		// band b ends on the row where the running total reaches (b + 1) / count of it,
+		// with a row at least left for every band after
+		uint64_t running = 0;
+		int row = 0;
+		for (unsigned b = 0; b < count; b++)
+		{
+			auto& ip = bands[b];
+			ip.row_start = row;
+
+			const uint64_t target = total * (b + 1) / count;
+			const int last_row = height - (count - b);
+			do {
+				running += last.row_cost[row].load(std::memory_order_relaxed);
+				row++;
+			} while (row <= last_row and running < target);
+
+			ip.row_end = row - 1;
+		}
+		bands.back().row_end = height - 1;
+	}
+
+	// Band b belongs to worker b % nthreads, which zeroes its rows first so their pages
+	// land on its NUMA node. Who runs a band is up to the deques, it's a best guess
+	void first_touch()
+	{
+		const unsigned nthreads = thread_manager.num_threads();
+		thread_manager.place([&](unsigned id) {
+			for (size_t b = id; b < in_per.size(); b += nthreads)
+			{
+				const size_t first = size_t(in_per[b].row_start) * width, last = size_t(in_per[b].row_end + 1) * width;
+				std::fill(out.canvas.begin() + first, out.canvas.begin() + last, 0);
+				std::fill(out.iters.begin() + first, out.iters.begin() + last, 0);
+			}
+		});
+	}
+
 	void launch()
 	{
+		launch(in_shared, in_per, out);
+	}
+
+	void launch(InShared& in, const std::vector<InPer>& bands, Out& result)
+	{
+		in.bands = bands;
+		result.pass_left = bands.size();
+		result.complete = false;
+		for (auto& cost : result.row_cost)
+			cost.store(0, std::memory_order_relaxed);
+
 		thread_manager.enqueue([&](std::queue<Command>& queue) {
-			Command cmd {
-				.type = CommandType::work,
-				.in_shared = &in_shared,
-				.out = &out,
-			};
-			for (auto& ip : in_per) {
-				cmd.in_per = &ip;
-				queue.push(cmd);
-			}
+			for (auto& ip : bands)
+				queue.push(thread_manager.band_command(&in, &result, ip, 0));
 		});
-		thread_manager.launch(in_per.size());
+		thread_manager.launch(bands.size());
 	}
 
 	void update(float delta_time) override
@@ -608,64 +1770,168 @@ private:
 					max_iterations = 1;
 				refresh();
 			}
+
+			flush_restart();
 		}
 	}
 
 	void draw(Buffer* buffer, float delta_time) override
 	{
+		std::scoped_lock lg(canvas_mtx);
 		memcpy(buffer->shm_data, out.canvas.data(), out.canvas.size() * sizeof(decltype(out.canvas)::value_type));
 	}
 
 private:
 	static void render_workplace(std::stop_token stop, Fractal* app)
 	{
-		mpfr_set_default_prec(zprec);
+		mpfr_set_default_prec(min_zprec);
 		mpfr_set_default_rounding_mode(app->def_rnd);
 
-		auto& canvas = app->out.canvas;
-		const size_t pixel_size = sizeof canvas[0];
+		const bool finished = app->args.refined.y4m
+			? app->render(stop, &Out::yuv)
+			: app->render(stop, &Out::canvas);
+		if (finished)
+			std::println(stderr, "Phew done!  ");
+
+		mpfr_free_cache();
+
+		app->is_rendering = false;
+	}
+
+	// What goes out of every frame is out.*output, frame N while the next ones are computed.
+	// False when stopped midway
+	template<class Buffer>
+	bool render(std::stop_token stop, Buffer Out::* output)
+	{
+		std::string stream_header, frame_header;
+		if (args.refined.y4m) {
+			stream_header = std::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C420jpeg\n", width, height, args.fps);
+			frame_header = "FRAME\n";
+		}
+		FrameWriter<Buffer> writer((out.*output).size(), std::move(stream_header), std::move(frame_header));
+
+		const bool finished = args.frames_in_flight > 1
+			? render_in_flight(stop, writer, output)
+			: render_one_by_one(stop, writer, output);
+		if (!finished)
+			return false;
+
+		const bool written = writer.finish();
+		iassert(written, "Writing out the last frame failed");
+		return true;
+	}
+
+	// range, start and delta of the frame
+	void frame_view(unsigned frame)
+	{
+		const double frame_ratio = frame / double(total_frames-1);
+
+		mpfr_mul_d(range[0], delta_range[0], frame_ratio, def_rnd);
+		mpfr_add(range[0], range[0], args.refined.start_range[0], def_rnd);
+
+		mpfr_mul_d(range[1], delta_range[1], frame_ratio, def_rnd);
+		mpfr_add(range[1], range[1], args.refined.start_range[1], def_rnd);
+
+		recalculate_start();
+		recalculate_delta();
+	}
+
+	void print_progress(unsigned frame)
+	{
+		if (args.silent)
+			return;
+
+		const double frame_ratio = frame / double(total_frames-1);
+		std::print(stderr, "\rRendering frame {} aka {:.3f}%, {:.6f}s...  ", frame + 1, frame_ratio * 100, frame_ratio * args.seconds);
+	}
 
-		for (unsigned frame=0; frame < app->total_frames; frame++)
+	template<class Buffer>
+	bool render_one_by_one(std::stop_token stop, FrameWriter<Buffer>& writer, Buffer Out::* output)
+	{
+		for (unsigned frame=0; frame < total_frames; frame++)
 		{
-			const double frame_ratio = frame / double(app->total_frames-1);
-			const double seconds_in = frame_ratio * app->args.seconds;
+			print_progress(frame);
 
-			if (!app->args.silent)
-				std::print(stderr, "\rRendering frame {} aka {:.3f}%, {:.6f}s...  ", frame + 1, frame_ratio * 100, seconds_in);
+			thread_manager.halt();
+			frame_view(frame);
+			restart(false);
 
-			app->thread_manager.halt();
+			if (!thread_manager.wait(stop)) {
+				thread_manager.halt();
+				return false;
+			}
 
-			mpfr_mul_d(app->range[0], app->delta_range[0], frame_ratio, app->def_rnd);
-			mpfr_add(app->range[0], app->range[0], app->args.refined.start_range[0], app->def_rnd);
+			const bool submitted = writer.submit(out.*output, &canvas_mtx);
+			iassert(submitted, "Writing out frame {} failed", frame);
+		}
+		return true;
+	}
 
-			mpfr_mul_d(app->range[1], app->delta_range[1], frame_ratio, app->def_rnd);
-			mpfr_add(app->range[1], app->range[1], app->args.refined.start_range[1], app->def_rnd);
+	// Up to frames_in_flight frames are worked on at once, each with a slot of its own,
+	// so small frames keep every worker busy. The slots make a reorder buffer, a frame
+	// done early waits in its slot until those before it are written out. The workers
+	// can only change precision while idle, a frame that needs a different one waits
+	// for the frames before it to finish
+	template<class Buffer>
+	bool render_in_flight(std::stop_token stop, FrameWriter<Buffer>& writer, Buffer Out::* output)
+	{
+		const unsigned depth = args.frames_in_flight;
 
-			app->recalculate_start();
-			app->recalculate_delta();
-			app->refresh();
+		thread_manager.halt();
+		std::vector<std::unique_ptr<RenderSlot>> slots;
+		for (unsigned _ : std::views::iota(0u, depth)) {
+			auto& slot = *slots.emplace_back(std::make_unique<RenderSlot>());
+			for (auto* vec : {&slot.in.center, &slot.in.range, &slot.in.start, &slot.in.delta})
+				alloc_zvec(*vec);
+			slot.in.width = width;
+			slot.in.height = height;
+			slot.bands = in_per;
+			slot.out.canvas = decltype(slot.out.canvas)(width * height);
+			slot.out.iters = decltype(slot.out.iters)(width * height);
+			slot.out.row_cost = decltype(slot.out.row_cost)(height);
+			slot.out.yuv = decltype(slot.out.yuv)(args.refined.y4m ? yuv420_size(width, height) : 0);
+		}
 
-			while (!app->thread_manager.is_done())
+		bool finished = true;
+		for (unsigned next = 0, written = 0; written < total_frames;)
+		{
+			for (; next < total_frames and next - written < depth; next++)
 			{
-				if (stop.stop_requested()) {
-					app->thread_manager.halt();
-					goto abrupt_exit;
+				frame_view(next);
+				if (required_precision() != zprec) {
+					if (next != written)
+						break;
+					thread_manager.wait();
 				}
 
-				std::this_thread::sleep_for(std::chrono::milliseconds(250));
+				// the slot last held frame next - depth, whose costs are the closest there are
+				auto& slot = *slots[next % depth];
+				reassign_dynamic(slot.in);
+				rebalance(slot.bands, slot.out);
+				launch(slot.in, slot.bands, slot.out);
 			}
 
-			std::cout.write(reinterpret_cast<const char*>(canvas.data()), canvas.size() * pixel_size);
-			iassert(!std::cout.bad());
-		}
-
-		std::println(stderr, "Phew done!  ");
+			auto& slot = *slots[written % depth];
+			if (!thread_manager.wait(stop, [&slot](){ return slot.out.complete.load(); })) {
+				finished = false;
+				break;
+			}
 
-abrupt_exit:
-		std::cout.flush();
-		mpfr_free_cache();
+			// the other slots are still being worked on, no bailing out before the halt below
+			print_progress(written);
+			if (!writer.submit(slot.out.*output)) {
+				spdlog::error("Writing out frame {} failed", written);
+				finished = false;
+				break;
+			}
+			written++;
+		}
 
-		app->is_rendering = false;
+		thread_manager.halt();
+		for (auto& slot : slots)
+			for (auto* vec : {&slot->in.center, &slot->in.range, &slot->in.start, &slot->in.delta})
+				free_zvec(*vec);
+		return finished;
 	}
 
 public:
@@ -718,6 +1984,20 @@ public:
 			}
 		}
 
+		if (args.output_format != "bgra" and args.output_format != "y4m")
+			throw std::runtime_error(std::format("--output-format is bgra or y4m, not {}", args.output_format));
+		args.refined.y4m = args.output_format == "y4m";
+		if (args.frames_in_flight < 1)
+			throw std::runtime_error(std::format("--frames-in-flight takes 1 or more: {}", args.frames_in_flight));
+		if (args.threads < 0)
+			throw std::runtime_error(std::format("--threads can't be negative: {}", args.threads));
+		if (!args.cpus.empty()) {
+			auto cpus = parse_cpu_list(args.cpus);
+			if (!cpus or cpus->empty())
+				throw std::runtime_error(std::format("--cpus wants a list like 0-7,16-23, not {}", args.cpus));
+			args.refined.cpus = std::move(*cpus);
+		}
+
 		if (args.help)
 		{
 			std::println(stderr, "Options:");
@@ -771,15 +2051,10 @@ private:
 
 		if (button == BTN_LEFT)
 		{
+			// snapped to the pixel grid so most of the canvas can stay
 			const auto& pos = input.pointer.pos;
-
-			mpfr_mul_ui(center[0], delta[0], pos.x, def_rnd);
-			mpfr_add(center[0], start[0], center[0], def_rnd);
-
-			mpfr_mul_ui(center[1], delta[1], height - pos.y - 1, def_rnd);
-			mpfr_add(center[1], start[1], center[1], def_rnd);
-
-			recalculate_start();
+			pan(std::lround(pos.x - width / 2.), std::lround(pos.y + 1 - height / 2.));
+			return;
 		}
 		else if (button == BTN_RIGHT)
 		{
@@ -799,6 +2074,89 @@ private:
 		refresh();
 	}
 
+	// Moves the view by whole pixels, new (col, row) shows what old (col + shift_x, row + shift_y)
+	// did. A finished canvas is shifted in place and only the exposed strips get computed
+	void pan(int shift_x, int shift_y)
+	{
+		mpfr_mul_si(temps[0], delta[0], shift_x, def_rnd);
+		mpfr_add(center[0], center[0], temps[0], def_rnd);
+		mpfr_mul_si(temps[1], delta[1], shift_y, def_rnd);
+		mpfr_sub(center[1], center[1], temps[1], def_rnd);
+		recalculate_start();
+
+		if (!out.complete or restart_pending or !thread_manager.is_done() or std::abs(shift_x) >= width or std::abs(shift_y) >= height) {
+			refresh();
+			return;
+		}
+		if (shift_x == 0 and shift_y == 0)
+			return;
+
+		shift_buffer(out.canvas, shift_x, shift_y);
+		shift_buffer(out.iters, shift_x, shift_y);
+		reassign_dynamic();
+
+		// the exposed column strip at full height, then the row strip next to it
+		std::vector<Rect> strips;
+		if (shift_x != 0)
+			strips.push_back(shift_x > 0 ? Rect {width - shift_x, 0, width, height} : Rect {0, 0, -shift_x, height});
+		if (shift_y != 0) {
+			const int x0 = std::max(-shift_x, 0), x1 = width - std::max(shift_x, 0);
+			strips.push_back(shift_y > 0 ? Rect {x0, height - shift_y, x1, height} : Rect {x0, 0, x1, -shift_y});
+		}
+
+		// split along the long side, between the two strips every thread gets a piece
+		const int pieces = std::max(1, int(thread_manager.num_threads()) / 2);
+		std::vector<Command> cmds;
+		for (const Rect& strip : strips)
+		{
+			const bool tall = strip.y1 - strip.y0 > strip.x1 - strip.x0;
+			const int length = tall ? strip.y1 - strip.y0 : strip.x1 - strip.x0;
+			for (int i = 0; i < pieces; i++)
+			{
+				const int a = length * i / pieces, b = length * (i + 1) / pieces;
+				if (a == b)
+					continue;
+
+				Rect piece = strip;
+				if (tall) {
+					piece.y0 = strip.y0 + a;
+					piece.y1 = strip.y0 + b;
+				} else {
+					piece.x0 = strip.x0 + a;
+					piece.x1 = strip.x0 + b;
+				}
+
+				cmds.push_back({
+					.type = CommandType::rect,
+					.in_shared = &in_shared,
+					.out = &out,
+					.rect = piece,
+					.pass = in_shared.passes - 1,
+				});
+			}
+		}
+
+		out.pass_left = cmds.size();
+		out.complete = false;
+		thread_manager.enqueue(cmds.begin(), cmds.end());
+		thread_manager.launch(cmds.size());
+	}
+
+	template<class Buffer>
+	void shift_buffer(Buffer& buffer, int shift_x, int shift_y)
+	{
+		const int cols = width - std::abs(shift_x);
+		const int src_col = std::max(shift_x, 0), dst_col = std::max(-shift_x, 0);
+
+		// rows in the order that never reads one already overwritten
+		const int rows = height - std::abs(shift_y);
+		for (int i = 0; i < rows; i++)
+		{
+			const int row = shift_y >= 0 ? i : height - 1 - i;
+			memmove(&buffer[(row * width) + dst_col], &buffer[((row + shift_y) * width) + src_col], cols * sizeof(typename Buffer::value_type));
+		}
+	}
+
 	void on_key(xkb_keysym_t key, wl_keyboard_key_state state) override
 	{
 		if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
@@ -921,6 +2279,8 @@ private:
 
 					switch (args.center_sway_mode) {
 					case 1: // fixed
+						grow_zvec(center, mpfr_get_prec(args.refined.final_center[0]));
+						grow_zvec(center, mpfr_get_prec(args.refined.final_center[1]));
 						mpfr_set(center[0], args.refined.final_center[0], def_rnd);
 						mpfr_set(center[1], args.refined.final_center[1], def_rnd);
 						break;
@@ -953,10 +2313,38 @@ private:
 						total_frames
 					);
 
+					is_rendering = true;
+
 					render_thread = std::jthread(render_workplace, this);
+				}
+			} break;
 
-					is_rendering = true;
+			case XKB_KEY_p: {
+				if (is_rendering) return;
+
+				switch (engine) {
+				case Engine::direct: engine = Engine::perturbation; break;
+				case Engine::perturbation: engine = Engine::fixed_point; break;
+				case Engine::fixed_point: engine = Engine::direct; break;
 				}
+				std::println(stderr, "Engine: {}", engine_name(engine));
+				refresh();
+			} break;
+
+			case XKB_KEY_g: {
+				if (is_rendering) return;
+
+				progressive = !progressive;
+				std::println(stderr, "Progressive rendering: {}", progressive ? "on" : "off");
+				refresh();
+			} break;
+
+			case XKB_KEY_m: {
+				if (is_rendering) return;
+
+				subdivide = !subdivide;
+				std::println(stderr, "Mariani-Silver: {}", subdivide ? "on" : "off");
+				refresh();
 			} break;
 
 			case XKB_KEY_l: {
@@ -980,6 +2368,19 @@ private: // helpers
 		}
 	}
 
+	// Raises the precision of vec to at least prec keeping its value, whether anything changed
+	bool grow_zvec(auto& vec, mpfr_prec_t prec)
+	{
+		bool grown = false;
+		for (auto& elem : vec) {
+			if (mpfr_get_prec(elem) < prec) {
+				mpfr_prec_round(elem, prec, def_rnd);
+				grown = true;
+			}
+		}
+		return grown;
+	}
+
 	void free_zvec(auto& vec)
 	{
 		for (auto& elem : vec) {
@@ -1006,6 +2407,13 @@ private: // helpers
 
 		str[comma] = '\0';
 
+		// keep every digit given, deep zoom coordinates don't fit in the default precision
+		const auto digits_prec = [](std::string_view s) {
+			return std::max(min_zprec, mpfr_prec_t(s.size() * 3.33) + 8);
+		};
+		mpfr_set_prec(vec[0], digits_prec(first));
+		mpfr_set_prec(vec[1], digits_prec(second));
+
 		iassert(mpfr_set_str(vec[0], first.data(), 10, def_rnd) == 0); 
 		iassert(mpfr_set_str(vec[1], second.data(), 10, def_rnd) == 0);
 	}
@@ -1032,6 +2440,30 @@ private: // helpers
 	}
 };
 
+// The same frame on 1, 2, 4... workers up to the pool size, a fresh pool every time.
+// The best of a few runs each, speedup against one worker
+static void bench(int argc, char** argv, unsigned pool)
+{
+	double one = 0;
+	for (unsigned threads = 1;; threads = std::min(threads * 2, pool))
+	{
+		Fractal app;
+		app.process_args(argc, argv);
+		app.initialize_bench(threads);
+
+		double best = app.bench_frame();
+		for (int run = 1; run < 3; run++)
+			best = std::min(best, app.bench_frame());
+		if (threads == 1)
+			one = best;
+
+		std::println("{:4} threads  {:8.3f} s  speedup {:6.2f}  efficiency {:5.1f}%",
+			threads, best, one / best, one / best / threads * 100);
+		if (threads == pool)
+			break;
+	}
+}
+
 int main(int argc, char** argv)
 {
 	auto stderr_logger = spdlog::stderr_color_mt("stderr_logger");
@@ -1043,6 +2475,10 @@ int main(int argc, char** argv)
     Fractal app;
     try {
 		app.process_args(argc, argv);
+		if (app.benching()) {
+			bench(argc, argv, app.pool_size());
+			return 0;
+		}
         app.initialize();
         app.run();
     } catch (const App::assertion&) {
@@ -1,46 +1,176 @@
 #include "fractal/app.hpp"
+#include "fractal/simd.hpp"
+#include "fractal/palette.hpp"
+#include "fractal/tile-cache.hpp"
+#include "fractal/work-deque.hpp"
+#include "fractal/affinity.hpp"
 
-using oreal = long double;
-using ocomplex = std::complex<oreal>;
+using oreal = qdreal;
 using ovec2 = glm::tvec2<oreal>;
 
+// Scalar type the kernel iterates in, cheapest first
+enum class Tier { f32, f64, f80, dd, qd };
+
+std::string_view tier_name(Tier tier)
+{
+	switch (tier) {
+	case Tier::f32: return "float";
+	case Tier::f64: return "double";
+	case Tier::f80: return "long double";
+	case Tier::dd: return "double-double";
+	case Tier::qd: return "quad-double";
+	}
+	return "?";
+}
+
+// One of C<T> for every tier's type, only the current tier's gets used
+template<template<class> class C>
+using PerTier = std::tuple<C<float>, C<double>, C<long double>, C<ddreal>, C<qdreal>>;
+
+template<class Func>
+void with_tier(Tier tier, Func func)
+{
+	switch (tier) {
+	case Tier::f32: func(float()); break;
+	case Tier::f64: func(double()); break;
+	case Tier::f80: func((long double)(0)); break;
+	case Tier::dd: func(ddreal()); break;
+	case Tier::qd: func(qdreal()); break;
+	}
+}
+
+// Where the orbit of every pixel stopped, kept for the ones the budget ran out on. Only
+// those get written, the pages nobody writes never get backed
+template<class T>
+struct Orbits {
+	FirstTouchVector<T> zr, zi;
+};
+
+// Whether T can still tell apart neighbouring pixels anywhere in the view, with a few bits to spare
+template<class T>
+bool resolves(const ovec2& start, const ovec2& range, const ovec2& delta)
+{
+	const oreal magnitude = std::max({
+		abs(start.x), abs(start.x + range.x),
+		abs(start.y), abs(start.y + range.y)
+	});
+	return magnitude * double(std::numeric_limits<T>::epsilon()) * 8 < std::min(delta.x, delta.y);
+}
+
+// Pixels [x0, x1) x [y0, y1)
+struct Rect {
+	int x0, y0, x1, y1;
+};
+
+// Mariani-Silver: only the border of a rect is iterated. A border of one iteration
+// count is filled in, anything else is split in four and the quarters become tasks
+// of their own. Below min_rect_size everything is iterated
+static constexpr int min_rect_size = 8;
+
+// Progressive rendering: a pass iterates one pixel per block of its size and paints the
+// whole block with it, skipping the pixels coarser passes already have. Bands run a pass
+// at a time, the last task of one queues the next, so a coarse block never lands on finer
+// data. A single pass render is just the last one
+static constexpr int progressive_blocks[] = {16, 4, 1};
+static constexpr unsigned progressive_passes = std::size(progressive_blocks);
+
+// Row commands get halved down to this by whoever runs them, the other halves go up for
+// stealing. Cut a whole number of coarsest blocks from the band start, no block straddles two
+static constexpr int tile_rows = progressive_blocks[0];
+
+// Spans get iterated this many pixels at a time, a cancelled frame is given up between them.
+// Deep pixels make a chunk slow, the kernels also look every kernel::cancel_check iterations
+static constexpr int cancel_chunk = 64;
+
 template<class TBase, class TInShared, class TInPer, class TOut>
 class ThreadManager
 {
 public:
-	enum class CommandType { quit, work };
+	enum class CommandType { quit, work, rect, rects, color, resume };
 	struct Command {
 		CommandType type;
 		const TInShared* in_shared;
 		const TInPer* in_per;
 		TOut* out;
+		Rect rect;
+		unsigned pass;
+		// stamped by enqueue(), anything from before the current generation is dropped
+		unsigned gen;
 	};
-	static constexpr std::ptrdiff_t semaphore_least_max_value = 64;
 
 private:
 	const TBase* app;
 	unsigned nthreads;
+	// worker i runs on cpus[i % size], none pins nothing
+	std::vector<int> cpus;
 
 	std::vector<std::thread> workers;
 
-	std::counting_semaphore<semaphore_least_max_value> command_semaphore {0};
+	// place() hands every worker placement once, they notice placement_epoch moved
+	std::function<void(unsigned)> placement;
+	std::atomic<unsigned> placement_epoch = 0, placement_left = 0;
+	std::vector<unsigned> placement_seen;
+
+	// Every worker has a deque of its own, what it spawns goes on the bottom of it and
+	// idle workers steal from the top. Commands from the main thread come through the
+	// injection queue. Sleeping workers wait on permits with atomic wait, idle counts the
+	// ones that are about to, so there's never more permits out than sleepers
+	std::atomic<unsigned> permits = 0;
+	std::unique_ptr<WorkDeque<Command>[]> deques;
 	std::mutex command_mutex;
 	std::queue<Command> command_queue;
+	std::atomic<unsigned> idle = 0;
+	// commands queued anywhere or being run, quits aside. Notified on reaching zero
+	std::atomic<unsigned> pending = 0;
 
 	std::unique_ptr<std::mutex[]> work_state;
-	std::vector<uint64_t> work_done;
-	std::atomic_bool stop = false;
+	std::vector<uint64_t> work_done, stolen_done;
+	std::vector<uint64_t> pixels_done, interior_done, filled_done;
+
+	// Bumped by cancel(), stale work checks it between rows and span chunks and the kernels every
+	// so many iterations. cancelled_at is when the last cancel() happened with work in flight, the
+	// worker that drains it logs how long it took
+	std::atomic<unsigned> generation = 0;
+	std::atomic<int64_t> cancelled_at = 0;
+	std::atomic<uint64_t> cancels = 0, cancel_ns_total = 0, cancel_ns_max = 0;
+
+	kernel::Isa isa;
+	std::vector<std::vector<unsigned>> iters_v;
+	std::vector<std::vector<float>> norms_v;
+	std::vector<std::vector<int>> cols_v;
+
+	template<class T>
+	struct Scratch {
+		std::vector<T> cr, ci, zr, zi;
+	};
+	std::vector<PerTier<Scratch>> scratch_v;
 
 public:
-	ThreadManager(const TBase* app, unsigned nthreads = std::thread::hardware_concurrency())
-		:app(app), nthreads(nthreads)
+	// nthreads of 0 means one per CPU given, or per hardware thread without any
+	ThreadManager(const TBase* app, unsigned threads = 0, std::vector<int> cpu_list = {})
+		:app(app), nthreads(threads != 0 ? threads : !cpu_list.empty() ? cpu_list.size() : std::thread::hardware_concurrency()),
+		cpus(std::move(cpu_list))
 	{
-		iassert(nthreads < semaphore_least_max_value, "Too many threads you got brother. Increase the semaphore's least max value");
+		iassert(nthreads != 0);
 
 		work_state = std::make_unique<std::mutex[]>(nthreads);
 		memset(work_state.get(), 0x00, sizeof(std::mutex) * nthreads);
+		deques = std::make_unique<WorkDeque<Command>[]>(nthreads);
 		work_done.resize(nthreads, 0);
-
+		stolen_done.resize(nthreads, 0);
+		pixels_done.resize(nthreads, 0);
+		interior_done.resize(nthreads, 0);
+		filled_done.resize(nthreads, 0);
+		iters_v.resize(nthreads);
+		norms_v.resize(nthreads);
+		cols_v.resize(nthreads);
+		scratch_v.resize(nthreads);
+		placement_seen.resize(nthreads, 0);
+
+		isa = kernel::detect_isa();
+		spdlog::info("Kernel ISA: {}", kernel::isa_name(isa));
+
+		spdlog::info("{} workers{}", nthreads, cpus.empty() ? ", unpinned" : "");
 		for (unsigned i : std::views::iota(0u, nthreads)) {
 			workers.emplace_back(ThreadManager::workplace, i, this);
 		}
@@ -51,10 +181,27 @@ public:
 		return nthreads;
 	}
 
+	// func(id) once on every worker, back when all of them are done. Only while quiet.
+	// Memory a worker writes first gets its pages from that worker's NUMA node
+	template<class Func>
+	void place(Func&& func)
+	{
+		placement = std::forward<Func>(func);
+		placement_left = nthreads;
+		placement_epoch++;
+		release(nthreads);
+
+		for (unsigned left; (left = placement_left) != 0;)
+			placement_left.wait(left);
+		placement = nullptr;
+	}
+
 	void enqueue(Command&& cmd, unsigned count = 1)
 	{
+		cmd.gen = generation;
 		const Command& cmd_cref = cmd;
 		command_mutex.lock();
+		pending += count;
 		for (unsigned _ : std::views::iota(0u, count)) {
 			command_queue.push(cmd_cref);
 		}
@@ -66,7 +213,10 @@ public:
 	{
 		command_mutex.lock();
 		for (auto it = begin; it != end; it++) {
-			command_queue.push(*it);
+			Command cmd = *it;
+			cmd.gen = generation;
+			pending++;
+			command_queue.push(cmd);
 		}
 		command_mutex.unlock();
 	}
@@ -74,27 +224,73 @@ public:
 	template<class Func>
 	void enqueue(Func setter)
 	{
+		std::queue<Command> fresh;
+		setter(fresh);
+
 		command_mutex.lock();
-		setter(command_queue);
+		pending += fresh.size();
+		for (; !fresh.empty(); fresh.pop()) {
+			Command cmd = fresh.front();
+			cmd.gen = generation;
+			command_queue.push(cmd);
+		}
 		command_mutex.unlock();
 	}
 
+	// What's queued, the deques get robbed like any thief would
 	void clear()
 	{
 		command_mutex.lock();
+		pending -= command_queue.size();
 		while (!command_queue.empty())
 			command_queue.pop();
 		command_mutex.unlock();
+
+		for (unsigned i : std::views::iota(0u, nthreads))
+			while (!deques[i].empty())
+				if (deques[i].steal())
+					pending--;
 	}
 
-	void halt()
+	// Makes everything queued or running stale without waiting for it, workers drop it
+	// on sight and give up on what they're at by the next span chunk
+	void cancel()
 	{
+		if (pending != 0)
+		{
+			int64_t none = 0;
+			cancelled_at.compare_exchange_strong(none, std::chrono::steady_clock::now().time_since_epoch().count());
+		}
+		generation++;
 		clear();
-		stop = true;
+	}
 
-		wait_all();
+	// Nothing queued nor running, the shared state is the main thread's to change
+	bool quiet() const
+	{
+		return pending == 0;
+	}
+
+	void halt()
+	{
+		cancel();
+
+		// a worker may have looked at the generation just before it went up and pushed
+		// something, it's stale all the same
+		wait();
+	}
 
-		stop = false;
+	// Done once there's nothing anywhere. The last task of a pass queues the next one
+	// before it counts itself off, so this is the whole frame
+	void wait()
+	{
+		for (unsigned left; (left = pending) != 0;)
+			pending.wait(left);
+	}
+
+	bool stale(const Command& cmd) const
+	{
+		return cmd.gen != generation.load(std::memory_order_relaxed);
 	}
 
 	void wait_all()
@@ -106,10 +302,92 @@ public:
 		}
 	}
 
-	// WARNING: Don't release if the semaphore counter is at its max capacity
-	void release(std::ptrdiff_t update = 1)
+	static Command band_command(const TInShared* in, TOut* out, const TInPer& band, unsigned pass)
 	{
-		command_semaphore.release(update);
+		const bool last = pass + 1 == in->passes;
+		return {
+			.type = last and in->subdivide ? CommandType::rect : CommandType::work,
+			.in_shared = in,
+			.in_per = &band,
+			.out = out,
+			.rect = {0, band.row_start, in->width, band.row_end + 1},
+			.pass = pass,
+		};
+	}
+
+	// Pixels [x0, x1) x [y0, y1) from their escape data to the canvas
+	static void colorize(const TInShared& in, TOut& out, const Rect& rect)
+	{
+		const float x0 = float(in.start.x + in.delta.x * rect.x0), dx = float(in.delta.x);
+		for (int row = rect.y0; row < rect.y1; row++)
+		{
+			const float y = float(in.start.y + in.delta.y * (in.height - row - 1));
+			const size_t index = at(rect.x0, row, in.width);
+			colorize_row(in.palette, in.max_iterations, x0, dx, y, &out.smooth[index], &out.canvas[index], rect.x1 - rect.x0);
+		}
+	}
+
+	// From worker id, more work for the current frame onto its own deque. Refused when
+	// stale or when the deque is full, the caller then does it itself
+	bool spawn(unsigned id, const Command& cmd)
+	{
+		if (stale(cmd))
+			return false;
+
+		// the caller's own task keeps pass_left above zero meanwhile
+		cmd.out->pass_left++;
+		pending++;
+		if (!deques[id].push(cmd)) {
+			cmd.out->pass_left--;
+			pending--;
+			return false;
+		}
+
+		release();
+		return true;
+	}
+
+	// From worker id finishing the last task of a pass, unless stale
+	void chain(unsigned id, const Command& cmd)
+	{
+		const auto& bands = cmd.in_shared->bands;
+		cmd.out->pass_left = bands.size();
+		if (stale(cmd))
+			return;
+
+		pending += bands.size();
+		for (const auto& band : bands)
+		{
+			Command next = band_command(cmd.in_shared, cmd.out, band, cmd.pass + 1);
+			next.gen = cmd.gen;
+			if (!deques[id].push(next)) {
+				command_mutex.lock();
+				command_queue.push(next);
+				command_mutex.unlock();
+			}
+		}
+
+		release(bands.size());
+	}
+
+	// Wakes up to update sleeping workers, the ones awake find the work on their own
+	void release(unsigned update = 1)
+	{
+		// the work has to be out before idle is looked at, sleep() does it the other way round
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		unsigned sleeping = idle;
+		unsigned woken;
+		do {
+			woken = std::min(update, sleeping);
+			if (woken == 0)
+				return;
+		} while (!idle.compare_exchange_weak(sleeping, sleeping - woken));
+
+		permits += woken;
+		if (woken == 1)
+			permits.notify_one();
+		else
+			permits.notify_all();
 	}
 
 	~ThreadManager()
@@ -117,15 +395,13 @@ public:
 		Command cmd_quit = {.type = CommandType::quit};
 
 		// Filling in the command queues
+		cancel();
 		command_mutex.lock();
-		while (!command_queue.empty())
-			command_queue.pop();
 		for (unsigned _ : std::views::iota(0u, nthreads))
 			command_queue.push(cmd_quit);
 		command_mutex.unlock();
 
 		// Signalling
-		stop = true;
 		release(nthreads);
 
 		// Waiting
@@ -147,6 +423,16 @@ public:
 			double dist = work_done[i] / double(total_work_done);
 			oss << dist * 100 << "%, ";
 		}
+		const auto total_stolen = std::accumulate(stolen_done.begin(), stolen_done.end(), uint64_t(0));
+		oss << "stolen = " << total_stolen << ", ";
+
+		const auto total_pixels = std::accumulate(pixels_done.begin(), pixels_done.end(), uint64_t(0));
+		const auto total_interior = std::accumulate(interior_done.begin(), interior_done.end(), uint64_t(0));
+		const auto total_filled = std::accumulate(filled_done.begin(), filled_done.end(), uint64_t(0));
+		oss << "interior early-outs = " << total_interior << " of " << total_pixels << " pixels, ";
+		oss << "filled without iterating = " << total_filled << ", ";
+		if (cancels != 0)
+			oss << "cancellation latency = " << cancel_ns_total / cancels / 1e3 << "us average, " << cancel_ns_max / 1e3 << "us max over " << cancels;
 
 		spdlog::debug(oss.str());
 	}
@@ -154,84 +440,427 @@ public:
 private:
 	static void workplace(unsigned id, ThreadManager* mgr)
 	{
+		if (!mgr->cpus.empty() and !pin_to_cpu(mgr->cpus[id % mgr->cpus.size()]))
+			spdlog::warn("Worker {} couldn't be pinned to CPU {}", id, mgr->cpus[id % mgr->cpus.size()]);
+
 		while (true)
 		{
-			mgr->command_semaphore.acquire();
-			mgr->command_mutex.lock();
-			if (mgr->command_queue.empty()) {
-				mgr->command_mutex.unlock();
+			mgr->run_placement(id);
+
+			const std::optional<Command> found = mgr->find(id);
+			if (!found) {
+				mgr->sleep(id);
 				continue;
 			}
-			Command cmd = mgr->command_queue.front();
-			mgr->command_queue.pop();
-			mgr->command_mutex.unlock();
+			Command cmd = *found;
 
 			// spdlog::debug("{}: Commanded {}", id, cmd.type == CommandType::quit ? "quit" : "work");
 
 			if (cmd.type == CommandType::quit)
 				break;
 
-			// Work
+			// Work, unless stale, then it's dropped
+			if (!mgr->stale(cmd))
 			{
 			std::lock_guard<std::mutex> lg(mgr->work_state[id]);
 
-			[[maybe_unused]] const int width = cmd.in_shared->width, height = cmd.in_shared->height;
-			const auto at_begin = at(0, cmd.in_per->row_start, width);
+			split(id, mgr, cmd);
 
-			const ovec2 start {
-				cmd.in_shared->center.x - cmd.in_shared->range.x / 2,
-				cmd.in_shared->center.y - cmd.in_shared->range.y / 2
-			};
-			const ovec2 delta {
-				cmd.in_shared->range.x / width,
-				cmd.in_shared->range.y / height
-			};
+			if (cmd.type == CommandType::color)
+				colorize(*cmd.in_shared, *cmd.out, cmd.rect);
+			else switch (cmd.in_shared->tier) {
+			case Tier::f32: work<float>(id, mgr, cmd); break;
+			case Tier::f64: work<double>(id, mgr, cmd); break;
+			case Tier::f80: work<long double>(id, mgr, cmd); break;
+			case Tier::dd: work<ddreal>(id, mgr, cmd); break;
+			case Tier::qd: work<qdreal>(id, mgr, cmd); break;
+			}
 
-			ocomplex coord;
+			// the last task of a pass, spawned ones included
+			if (--cmd.out->pass_left == 0) {
+				if (cmd.pass + 1 < cmd.in_shared->passes)
+					mgr->chain(id, cmd);
+				else if (!mgr->stale(cmd))
+					cmd.out->complete = true;
+			}
 
-			auto index = at_begin;
-			for (int row = cmd.in_per->row_start; row <= cmd.in_per->row_end; row++)
-			{
-				coord.imag(start.y + delta.y * (height - row - 1));
-				for (int col = 0; col < width; col++, index++)
-				{
-					coord.real(start.x + delta.x * col);
+			mgr->work_done[id]++;
+			}
+			if (--mgr->pending == 0) {
+				mgr->drained();
+				mgr->pending.notify_all();
+			}
+		}
+	}
 
-					unsigned iter = 0; ocomplex z(0, 0);
-					for (; iter < cmd.in_shared->max_iterations; iter++)
-					{
-						auto f_z = z*z + coord;
+	void drained()
+	{
+		const int64_t at = cancelled_at.exchange(0);
+		if (at == 0)
+			return;
+
+		const uint64_t ns = std::chrono::steady_clock::now().time_since_epoch().count() - at;
+		cancels++;
+		cancel_ns_total += ns;
+		if (ns > cancel_ns_max)
+			cancel_ns_max = ns;
+	}
 
-						if (std::norm(f_z) > 4)
-							break;
+	void run_placement(unsigned id)
+	{
+		const unsigned epoch = placement_epoch;
+		if (placement_seen[id] == epoch)
+			return;
+
+		placement_seen[id] = epoch;
+		placement(id);
+		if (--placement_left == 0)
+			placement_left.notify_all();
+	}
 
-						z = f_z;
-					}
+	// Own deque first, newest first while it's still in cache, then the injection
+	// queue, then the oldest, biggest piece of somebody else's
+	std::optional<Command> find(unsigned id)
+	{
+		if (auto cmd = deques[id].pop())
+			return cmd;
 
-					glm::vec3 color {};
+		command_mutex.lock();
+		if (!command_queue.empty()) {
+			const Command cmd = command_queue.front();
+			command_queue.pop();
+			command_mutex.unlock();
+			return cmd;
+		}
+		command_mutex.unlock();
+
+		for (unsigned k = 1; k < nthreads; k++)
+			if (auto cmd = deques[(id + k) % nthreads].steal()) {
+				stolen_done[id]++;
+				return cmd;
+			}
+		return std::nullopt;
+	}
+
+	// Something may have turned up between find() and idle going up, a pusher that saw
+	// idle up has a permit on its way though, take that or the claim back
+	void sleep(unsigned id)
+	{
+		idle++;
 
-					color.r = 1 + glm::sin((iter / float(cmd.in_shared->max_iterations)) * 2 * M_PIf + std::abs(coord));
-					color.r /= 2;
-					color.g = 1 + glm::sin(color.r * 2 * M_PIf + M_PIf / 4);
-					color.g /= 2;
-					color.b = 1 + glm::cos(color.g * 2 * M_PIf);
-					color.b /= 2;
+		if (has_work(id))
+		{
+			unsigned sleeping = idle;
+			while (sleeping != 0 and !idle.compare_exchange_weak(sleeping, sleeping - 1));
+			if (sleeping != 0)
+				return;
+		}
 
-					cmd.out->canvas[index] = color_u32(color);
+		// Permits go to whoever's first, one that did its part of a placement would take
+		// those meant for the ones still to do theirs. It waits the placement out instead
+		for (unsigned left; placement_seen[id] == placement_epoch and (left = placement_left) != 0;)
+			placement_left.wait(left);
+
+		// a permit, the counter is waited on directly
+		for (unsigned available = permits;;)
+		{
+			if (available == 0) {
+				permits.wait(0);
+				available = permits;
+			} else if (permits.compare_exchange_weak(available, available - 1)) {
+				return;
+			}
+		}
+	}
+
+	bool has_work(unsigned id)
+	{
+		if (placement_seen[id] != placement_epoch)
+			return true;
+
+		command_mutex.lock();
+		const bool queued = !command_queue.empty();
+		command_mutex.unlock();
+		if (queued)
+			return true;
+
+		for (unsigned i : std::views::iota(0u, nthreads))
+			if (!deques[i].empty())
+				return true;
+		return false;
+	}
+
+	// Row commands from their band, halved while taller than tile_rows
+	static void split(unsigned id, ThreadManager* mgr, Command& cmd)
+	{
+		if (cmd.type != CommandType::work and cmd.type != CommandType::color and cmd.type != CommandType::resume)
+			return;
+
+		while (cmd.rect.y1 - cmd.rect.y0 > tile_rows)
+		{
+			const int half = (cmd.rect.y1 - cmd.rect.y0) / 2;
+			const int cut = cmd.rect.y0 + (half + tile_rows - 1) / tile_rows * tile_rows;
+
+			Command far = cmd;
+			far.rect.y0 = cut;
+			if (!mgr->spawn(id, far))
+				break;
+			cmd.rect.y1 = cut;
+		}
+	}
+
+	template<class T>
+	static void work(unsigned id, ThreadManager* mgr, const Command& cmd)
+	{
+		if (cmd.type == CommandType::rect) {
+			subdivide<T>(id, mgr, cmd, cmd.rect);
+			return;
+		}
+
+		if (cmd.type == CommandType::resume) {
+			resume<T>(id, mgr, cmd);
+			return;
+		}
+
+		// a shared list, every thread takes the next one until it runs out
+		if (cmd.type == CommandType::rects) {
+			const auto& rects = cmd.in_shared->rects;
+			for (size_t i; !mgr->stale(cmd) and (i = cmd.out->next_rect++) < rects.size();)
+				subdivide<T>(id, mgr, cmd, rects[i]);
+			return;
+		}
+
+		const auto& in = *cmd.in_shared;
+		const unsigned level = progressive_passes - in.passes + cmd.pass;
+		const int block = progressive_blocks[level];
+		const int coarser = cmd.pass == 0 ? 0 : progressive_blocks[level - 1];
+		// tiles start a whole number of coarsest blocks into their band
+		const int row_start = cmd.rect.y0, row_end = cmd.rect.y1 - 1;
+
+		for (int row = row_start; row <= row_end; row += block)
+		{
+			if (coarser != 0 and (row - row_start) % coarser == 0) {
+				for (int col = block; col < coarser; col += block)
+					iterate_span<T>(id, mgr, cmd, col, row, (in.width - col + coarser - 1) / coarser, coarser, 0);
+			} else {
+				iterate_span<T>(id, mgr, cmd, 0, row, (in.width + block - 1) / block, block, 0);
+			}
+
+			if (block > 1)
+				for (int col = 0; col < in.width; col += block)
+					fill_block(cmd, col, row, block, row_end);
+			colorize(in, *cmd.out, {0, row, in.width, std::min(row + block, row_end + 1)});
+
+			if (mgr->stale(cmd)) break;
+		}
+	}
+
+	template<class T>
+	static void subdivide(unsigned id, ThreadManager* mgr, const Command& cmd, const Rect& rect)
+	{
+		const int w = rect.x1 - rect.x0, h = rect.y1 - rect.y0;
+		if (w <= 0 or h <= 0 or mgr->stale(cmd))
+			return;
+
+		const auto& in = *cmd.in_shared;
+		auto& out = *cmd.out;
+
+		if (!in.subdivide or w <= min_rect_size or h <= min_rect_size)
+		{
+			for (int row = rect.y0; row < rect.y1 and !mgr->stale(cmd); row++) {
+				iterate_span<T>(id, mgr, cmd, rect.x0, row, w, 1, 0);
+				colorize(in, out, {rect.x0, row, rect.x1, row + 1});
+			}
+			return;
+		}
+
+		iterate_span<T>(id, mgr, cmd, rect.x0, rect.y0, w, 1, 0);
+		iterate_span<T>(id, mgr, cmd, rect.x0, rect.y1 - 1, w, 1, 0);
+		iterate_span<T>(id, mgr, cmd, rect.x0, rect.y0 + 1, h - 2, 0, 1);
+		iterate_span<T>(id, mgr, cmd, rect.x1 - 1, rect.y0 + 1, h - 2, 0, 1);
+
+		for (const Rect& edge : {
+			Rect {rect.x0, rect.y0, rect.x1, rect.y0 + 1}, Rect {rect.x0, rect.y1 - 1, rect.x1, rect.y1},
+			Rect {rect.x0, rect.y0 + 1, rect.x0 + 1, rect.y1 - 1}, Rect {rect.x1 - 1, rect.y0 + 1, rect.x1, rect.y1 - 1}
+		})
+			colorize(in, out, edge);
+
+		const int width = in.width;
+		const auto& iters = out.iters;
+
+		const unsigned first = iters[at(rect.x0, rect.y0, width)];
+		bool uniform = true;
+		for (int col = rect.x0; col < rect.x1 and uniform; col++)
+			uniform = iters[at(col, rect.y0, width)] == first and iters[at(col, rect.y1 - 1, width)] == first;
+		for (int row = rect.y0 + 1; row < rect.y1 - 1 and uniform; row++)
+			uniform = iters[at(rect.x0, row, width)] == first and iters[at(rect.x1 - 1, row, width)] == first;
+
+		// Only an interior border fills, an escaped one with the same count still has
+		// smooth counts that differ inside
+		const Rect inner = {rect.x0 + 1, rect.y0 + 1, rect.x1 - 1, rect.y1 - 1};
+		if (uniform and first == in.max_iterations)
+		{
+			// no orbits for the filled pixels, a bigger budget has to start over
+			out.resumable = false;
+			for (int row = inner.y0; row < inner.y1; row++)
+				fill_from(out, at(rect.x0, rect.y0, width), at(inner.x0, row, width), at(inner.x1, row, width));
+			colorize(in, out, inner);
+			mgr->filled_done[id] += size_t(inner.x1 - inner.x0) * (inner.y1 - inner.y0);
+			return;
+		}
+
+		const int mx = (inner.x0 + inner.x1) / 2, my = (inner.y0 + inner.y1) / 2;
+		for (const Rect& quarter : {
+			Rect {inner.x0, inner.y0, mx, my}, Rect {mx, inner.y0, inner.x1, my},
+			Rect {inner.x0, my, mx, inner.y1}, Rect {mx, my, inner.x1, inner.y1}
+		}) {
+			Command sub = cmd;
+			sub.type = CommandType::rect;
+			sub.rect = quarter;
+			if (!mgr->spawn(id, sub))
+				subdivide<T>(id, mgr, cmd, quarter);
+		}
+	}
+
+	// count pixels from (col, row) on, (step_col, step_row) apart, cancel_chunk at a time
+	template<class T>
+	static void iterate_span(unsigned id, ThreadManager* mgr, const Command& cmd, int col, int row, int count, int step_col, int step_row)
+	{
+		const auto& in = *cmd.in_shared;
+		const auto& start = in.start;
+		const auto& delta = in.delta;
+
+		auto& iters = mgr->iters_v[id];
+		auto& norms = mgr->norms_v[id];
+		auto& scratch = std::get<Scratch<T>>(mgr->scratch_v[id]);
+		auto& zr = scratch.zr, & zi = scratch.zi;
+		for (auto* v : {&zr, &zi})
+			v->resize(std::max<size_t>(v->size(), cancel_chunk));
+		iters.resize(std::max<size_t>(iters.size(), cancel_chunk));
+		norms.resize(std::max<size_t>(norms.size(), cancel_chunk));
+
+		auto& out = *cmd.out;
+		auto& orbits = std::get<Orbits<T>>(out.orbits);
+
+		for (int first = 0; first < count and !mgr->stale(cmd); first += cancel_chunk)
+		{
+			const int n = std::min(cancel_chunk, count - first);
+			const int c = col + step_col * first, r = row + step_row * first;
+
+			const oreal x = start.x + delta.x * c;
+			const oreal y = start.y + delta.y * (in.height - r - 1);
+			const kernel::Span<T> span = {
+				T(x), T(delta.x * step_col),
+				T(y), T(-delta.y * step_row),
+				n, in.max_iterations, iters.data(), norms.data(), zr.data(), zi.data(),
+				&mgr->generation, cmd.gen
+			};
+
+			const unsigned interior = kernel::iterate<T>(mgr->isa, span);
+			if (mgr->stale(cmd))
+				return;
+			mgr->interior_done[id] += interior;
+			mgr->pixels_done[id] += n;
+
+			for (int i = 0; i < n; i++)
+			{
+				const auto index = at(c + step_col * i, r + step_row * i, in.width);
+				out.iters[index] = iters[i];
+				out.smooth[index] = smooth_escape(iters[i], norms[i], in.max_iterations);
+				out.abs_z[index] = std::sqrt(norms[i]);
+				if (iters[i] == in.max_iterations) {
+					orbits.zr[index] = zr[i];
+					orbits.zi[index] = zi[i];
 				}
+			}
+		}
+	}
 
-				if (mgr->stop) break;
+	// The budget went up from in.resume_from, everything that ran out of the old one
+	// carries on. Escaped and interior pixels are left be, only the colours get redone
+	template<class T>
+	static void resume(unsigned id, ThreadManager* mgr, const Command& cmd)
+	{
+		const auto& in = *cmd.in_shared;
+		auto& out = *cmd.out;
+		auto& orbits = std::get<Orbits<T>>(out.orbits);
+
+		auto& iters = mgr->iters_v[id];
+		auto& norms = mgr->norms_v[id];
+		auto& cols = mgr->cols_v[id];
+		auto& [cr, ci, zr, zi] = std::get<Scratch<T>>(mgr->scratch_v[id]);
+		for (auto* v : {&cr, &ci, &zr, &zi})
+			v->resize(std::max<size_t>(v->size(), in.width));
+		iters.resize(std::max<size_t>(iters.size(), in.width));
+		norms.resize(std::max<size_t>(norms.size(), in.width));
+		cols.resize(std::max<size_t>(cols.size(), in.width));
+
+		const T x0 = T(in.start.x), dx = T(in.delta.x), dy = T(in.delta.y);
+
+		for (int row = cmd.rect.y0; row < cmd.rect.y1 and !mgr->stale(cmd); row++)
+		{
+			const T y = T(in.start.y + in.delta.y * (in.height - row - 1));
+
+			int count = 0;
+			for (int col = 0; col < in.width; col++)
+			{
+				const auto index = at(col, row, in.width);
+				if (out.iters[index] != in.resume_from)
+					continue;
+
+				cr[count] = x0 + dx * col;
+				ci[count] = y;
+				zr[count] = orbits.zr[index];
+				zi[count] = orbits.zi[index];
+				iters[count] = in.resume_from;
+				cols[count] = col;
+				count++;
 			}
 
-			mgr->work_done[id]++;
+			for (int first = 0; first < count and !mgr->stale(cmd); first += cancel_chunk)
+			{
+				const kernel::Resume<T> resume = {
+					&cr[first], &ci[first], &zr[first], &zi[first], dx, dy,
+					std::min(cancel_chunk, count - first), in.max_iterations, &iters[first], &norms[first],
+					&mgr->generation, cmd.gen
+				};
+				mgr->interior_done[id] += kernel::resume_scalar(resume);
 			}
+			if (mgr->stale(cmd))
+				return;
+			mgr->pixels_done[id] += count;
+
+			for (int i = 0; i < count; i++)
+			{
+				const auto index = at(cols[i], row, in.width);
+				out.iters[index] = iters[i];
+				out.smooth[index] = smooth_escape(iters[i], norms[i], in.max_iterations);
+				out.abs_z[index] = std::sqrt(norms[i]);
+				orbits.zr[index] = zr[i];
+				orbits.zi[index] = zi[i];
+			}
+
+			colorize(in, out, {0, row, in.width, row + 1});
 		}
 	}
 
-	static uint32_t color_u32(glm::vec3 color)
+	// Copies the block's top left pixel over the rest of it, clipped to the band
+	static void fill_block(const Command& cmd, int col, int row, int block, int row_end)
 	{
-		color = glm::clamp(color, glm::vec3(0), glm::vec3(1));
-		return (uint32_t(color.r * 255)) << 16 | (uint32_t(color.g * 255)) << 8 | uint32_t(color.b * 255);
+		const int width = cmd.in_shared->width;
+		const int col_end = std::min(col + block, width);
+		for (int r = row; r <= std::min(row + block - 1, row_end); r++)
+			fill_from(*cmd.out, at(col, row, width), at(col, r, width), at(col_end, r, width));
+	}
+
+	// Escape data of pixel from over the pixels [first, last)
+	static void fill_from(TOut& out, size_t from, size_t first, size_t last)
+	{
+		const unsigned iter = out.iters[from];
+		const float smooth = out.smooth[from], abs_z = out.abs_z[from];
+		std::fill(out.iters.begin() + first, out.iters.begin() + last, iter);
+		std::fill(out.smooth.begin() + first, out.smooth.begin() + last, smooth);
+		std::fill(out.abs_z.begin() + first, out.abs_z.begin() + last, abs_z);
 	}
 
 	static size_t at(int col, int row, int width)
@@ -242,19 +871,38 @@ private:
 
 class Fractal : public App
 {
+	struct InPer {
+		int row_start, row_end;
+	};
 	struct InShared {
 		int width, height;
 		ovec2 center, range;
-		unsigned max_iterations;
-	};
-	struct InPer {
-		int row_start, row_end;
+		ovec2 start, delta;
+		unsigned max_iterations, resume_from;
+		Palette palette;
+		Tier tier;
+		bool subdivide;
+		unsigned passes;
+		std::span<const InPer> bands;
+		std::span<const Rect> rects;
+		int zoom;
+		int64_t origin_x, origin_y;
 	};
+	// Escape data of every pixel, one array per field, and the colours made out of it.
+	// Workers first touch the rows of their bands, see first_touch()
 	struct Out {
-		std::vector<uint32_t> canvas;
+		FirstTouchVector<uint32_t> canvas;
+		FirstTouchVector<unsigned> iters;
+		FirstTouchVector<float> smooth, abs_z;
+		PerTier<Orbits> orbits;
+		std::atomic<unsigned> pass_left;
+		std::atomic_bool complete;
+		std::atomic<size_t> next_rect;
+		// every pixel that ran out of budget has its orbit
+		std::atomic_bool resumable;
 	};
 
-	InShared in_shared;
+	InShared in_shared {};
 	std::vector<InPer> in_per;
 	Out out;
 
@@ -265,10 +913,28 @@ class Fractal : public App
 
 	ovec2 center, range;
 	float max_iterations;
+	bool subdivide = false;
+	bool progressive = true;
+	std::optional<Tier> last_tier;
+	Palette palette;
+	bool cycling = false;
+	static constexpr float cycle_speed = M_PIf / 2;
+
+	// Zoom level n has range = base_range * zoom_factor^n and its pixel grid counted from
+	// anchor, both reset whenever the range gets set any other way
+	static constexpr double zoom_factor = 0.8;
+	static constexpr size_t tile_cache_bytes = size_t(256) << 20;
+	TileCache tile_cache {tile_cache_bytes};
+	ovec2 anchor, base_range;
+	int zoom = 0;
+	bool cache_pending = false;
+	std::vector<Rect> missing;
+	// refresh() only cancels, the restart happens once per update() when the workers are done
+	bool restart_pending = false;
 	
 public:
-	Fractal()
-		:thread_manager(this)
+	Fractal(unsigned nthreads, std::vector<int> cpus)
+		:thread_manager(this, nthreads, std::move(cpus))
 	{
 		title = "Fractal";
 		center = {0, 0};
@@ -276,6 +942,21 @@ public:
 		max_iterations = 40;
 	}
 
+	// One frame of the seahorse valley at the window's default size, without a window.
+	// Seconds from the restart to the last pass done
+	double bench_frame()
+	{
+		center = {-0.743643887037158704752191506114774, 0.131825904205311970493132056385139};
+		range = {1e-10, 1e-10};
+		max_iterations = 3000;
+		correct_by_aspect();
+
+		const auto begin = std::chrono::steady_clock::now();
+		refresh(true);
+		thread_manager.wait();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
 private:
 	void setup_pre() override
 	{
@@ -293,33 +974,148 @@ private:
 		range.y = range.x * (height / float(width));
 	}
 
+	// Parameter changes between two updates make one restart, the UI never waits for the
+	// workers to drop the old frame. Except on resize, the buffers can't wait
 	void refresh(bool resize = false)
 	{
 		if (resize and false) {
 			correct_by_aspect();
 		}
 
-		thread_manager.halt();
+		if (resize) {
+			thread_manager.halt();
+			restart_pending = false;
+			restart(true);
+			return;
+		}
+
+		thread_manager.cancel();
+		restart_pending = true;
+	}
+
+	void flush_restart()
+	{
+		if (restart_pending and thread_manager.quiet()) {
+			restart_pending = false;
+			restart(false);
+		}
+	}
 
+	void restart(bool resize)
+	{
 		if (resize) {
 			in_shared.width = width;
 			in_shared.height = height;
-			out.canvas.resize(width * height);
+			// new allocations rather than resizes, nothing gets copied over and touched here
+			out.canvas = decltype(out.canvas)(width * height);
+			out.iters = decltype(out.iters)(width * height);
+			out.smooth = decltype(out.smooth)(width * height);
+			out.abs_z = decltype(out.abs_z)(width * height);
+			rebase_zoom();
 		}
 		reassign_dynamic();
+		size_orbits();
 
 		if (resize) {
 			distribute();
+			first_touch();
 		}
 
-		pump();
+		out.resumable = true;
+		if (fetch_tiles())
+			pump_missing();
+		else
+			pump();
+		cache_pending = true;
+	}
+
+	// Only the current tier's orbits take up memory
+	void size_orbits()
+	{
+		std::apply([&](auto&... orbits) {
+			(size_orbits(orbits), ...);
+		}, out.orbits);
+	}
+
+	template<class T>
+	void size_orbits(Orbits<T>& orbits)
+	{
+		bool current = false;
+		with_tier(in_shared.tier, [&]<class U>(U) {
+			current = std::is_same_v<T, U>;
+		});
+
+		// new allocations, left untouched until a worker stores an orbit
+		if (!current)
+			orbits = {};
+		else if (orbits.zr.size() != size_t(width * height))
+			orbits = {decltype(orbits.zr)(width * height), decltype(orbits.zi)(width * height)};
+	}
+
+	// The range was set by something other than zooming, old levels don't line up anymore
+	void rebase_zoom()
+	{
+		anchor = center;
+		base_range = range;
+		zoom = 0;
+		tile_cache.clear();
+	}
+
+	// From the base every time, coming back to a level gives the very same range
+	ovec2 level_range() const
+	{
+		ovec2 level = base_range;
+		for (int i = 0; i < std::abs(zoom); i++) {
+			if (zoom > 0)
+				level *= zoom_factor;
+			else
+				level /= zoom_factor;
+		}
+		return level;
 	}
 
 	void reassign_dynamic()
 	{
 		in_shared.center = center;
 		in_shared.range = range;
+		in_shared.delta = {range.x / width, range.y / height};
+
+		// snapped to the pixel grid of the zoom level, so tiles line up between views.
+		// Grid pixel (gx, gy) sits at anchor + (gx, -gy) * delta, rows go down like on screen
+		const ovec2 start = {center.x - range.x / 2, center.y - range.y / 2};
+		in_shared.zoom = zoom;
+		in_shared.origin_x = std::llround(leading((start.x - anchor.x) / in_shared.delta.x));
+		in_shared.origin_y = std::llround(leading((anchor.y - start.y) / in_shared.delta.y)) - (height - 1);
+		in_shared.start = {
+			anchor.x + in_shared.delta.x * double(in_shared.origin_x),
+			anchor.y - in_shared.delta.y * double(in_shared.origin_y + height - 1)
+		};
 		in_shared.max_iterations = max_iterations;
+		in_shared.palette = palette;
+		in_shared.subdivide = subdivide;
+		in_shared.passes = progressive ? progressive_passes : 1;
+
+		const Tier tier = pick_tier();
+		if (tier != last_tier)
+			spdlog::info("Precision tier: {}", tier_name(tier));
+		in_shared.tier = *(last_tier = tier);
+	}
+
+	// Cheapest scalar type that still resolves range / width. long double runs on the x87 unit,
+	// past it double-double and quad-double cover zooms down to about 1e-60
+	Tier pick_tier() const
+	{
+		const auto& [start, delta] = std::tie(in_shared.start, in_shared.delta);
+
+		if (resolves<float>(start, range, delta))
+			return Tier::f32;
+		if (resolves<double>(start, range, delta))
+			return Tier::f64;
+		if (resolves<long double>(start, range, delta))
+			return Tier::f80;
+		if (resolves<ddreal>(start, range, delta))
+			return Tier::dd;
+		return Tier::qd;
 	}
 
 	void distribute()
@@ -351,30 +1147,205 @@ private:
 		}
 	}
 
+	// Band b belongs to worker b % nthreads, which zeroes its rows first so their pages
+	// land on its NUMA node. Stealing moves some of the work around, most stays put
+	void first_touch()
+	{
+		const unsigned nthreads = thread_manager.num_threads();
+		thread_manager.place([&](unsigned id) {
+			for (size_t b = id; b < in_per.size(); b += nthreads)
+			{
+				const size_t first = size_t(in_per[b].row_start) * width, last = size_t(in_per[b].row_end + 1) * width;
+				std::fill(out.canvas.begin() + first, out.canvas.begin() + last, 0);
+				std::fill(out.iters.begin() + first, out.iters.begin() + last, 0);
+				std::fill(out.smooth.begin() + first, out.smooth.begin() + last, 0);
+				std::fill(out.abs_z.begin() + first, out.abs_z.begin() + last, 0);
+			}
+		});
+	}
+
 	void pump()
 	{
+		in_shared.bands = in_per;
+		out.pass_left = in_per.size();
+		out.complete = false;
+
 		auto command_setter = [&](std::queue<Command>& queue) {
-			Command cmd {
-				.type = CommandType::work,
-				.in_shared = &in_shared,
-				.out = &out,
-			};
-			for (auto& ip : in_per) {
-				cmd.in_per = &ip;
-				queue.push(cmd);
-			}
+			for (auto& ip : in_per)
+				queue.push(thread_manager.band_command(&in_shared, &out, ip, 0));
 		};
 		thread_manager.enqueue(command_setter);
 		thread_manager.release(in_per.size());
 	}
 
+	// Same view with a bigger budget, only the pixels that ran out of the old one get
+	// iterated, from where they stopped. update() keeps calling it until the frame in the works is done
+	void raise_iterations()
+	{
+		const unsigned from = in_shared.max_iterations;
+		if (unsigned(max_iterations) == from or restart_pending)
+			return;
+		if (!out.resumable or unsigned(max_iterations) < from) {
+			refresh();
+			return;
+		}
+		if (!out.complete or !thread_manager.quiet())
+			return;
+
+		reassign_dynamic();
+		in_shared.resume_from = from;
+		in_shared.bands = in_per;
+		out.pass_left = in_per.size();
+		out.complete = false;
+
+		thread_manager.enqueue([&](std::queue<Command>& queue) {
+			for (auto& ip : in_per)
+				queue.push({
+					.type = CommandType::resume,
+					.in_shared = &in_shared,
+					.in_per = &ip,
+					.out = &out,
+					.rect = {0, ip.row_start, width, ip.row_end + 1},
+					.pass = in_shared.passes - 1,
+				});
+		});
+		thread_manager.release(in_per.size());
+		cache_pending = true;
+	}
+
+	// Same frame in another palette, only the colouring pass runs
+	void recolor()
+	{
+		in_shared.palette = palette;
+		out.pass_left = in_per.size();
+		out.complete = false;
+
+		thread_manager.enqueue([&](std::queue<Command>& queue) {
+			for (auto& ip : in_per)
+				queue.push({
+					.type = CommandType::color,
+					.in_shared = &in_shared,
+					.in_per = &ip,
+					.out = &out,
+					.rect = {0, ip.row_start, width, ip.row_end + 1},
+					.pass = in_shared.passes - 1,
+				});
+		});
+		thread_manager.release(in_per.size());
+	}
+
+	// Only what the cache didn't have, in one go at the last pass
+	void pump_missing()
+	{
+		in_shared.rects = missing;
+		out.next_rect = 0;
+
+		const unsigned n = std::min<size_t>(missing.size(), thread_manager.num_threads());
+		out.pass_left = n;
+		out.complete = n == 0;
+		if (n == 0)
+			return;
+
+		thread_manager.enqueue({
+			.type = CommandType::rects,
+			.in_shared = &in_shared,
+			.out = &out,
+			.pass = in_shared.passes - 1,
+		}, n);
+		thread_manager.release(n);
+	}
+
+	// func(key, extent, col, row) for every tile the view touches, extent being the part of it
+	// on screen and (col, row) where that part starts on the canvas
+	template<class Func>
+	void for_each_tile(Func func) const
+	{
+		constexpr int size = TileCache::tile_size;
+		const int64_t ox = in_shared.origin_x, oy = in_shared.origin_y;
+
+		for (int64_t ty = TileCache::tile_of(oy); ty <= TileCache::tile_of(oy + height - 1); ty++)
+			for (int64_t tx = TileCache::tile_of(ox); tx <= TileCache::tile_of(ox + width - 1); tx++)
+			{
+				const TileCache::Key key = {in_shared.zoom, tx, ty, in_shared.max_iterations, int(in_shared.tier), in_shared.subdivide};
+				const int64_t gx = tx * size, gy = ty * size;
+				const TileCache::Extent extent = {
+					int(std::max(ox, gx) - gx), int(std::max(oy, gy) - gy),
+					int(std::min(ox + width, gx + size) - gx), int(std::min(oy + height, gy + size) - gy),
+				};
+				func(key, extent, int(gx + extent.x0 - ox), int(gy + extent.y0 - oy));
+			}
+	}
+
+	// Copies in whatever the cache has of the view and lists the rest in missing.
+	// False if it had nothing, the usual passes are nicer to look at then
+	bool fetch_tiles()
+	{
+		missing.clear();
+
+		bool any = false;
+		for_each_tile([&](const TileCache::Key& key, const TileCache::Extent& extent, int col, int row) {
+			const int w = extent.x1 - extent.x0, h = extent.y1 - extent.y0;
+
+			const auto* tile = tile_cache.find(key, extent);
+			if (!tile) {
+				missing.push_back({col, row, col + w, row + h});
+				return;
+			}
+
+			for (int r = 0; r < h; r++)
+			{
+				const size_t from = (extent.y0 + r) * TileCache::tile_size + extent.x0;
+				const size_t to = (row + r) * width + col;
+				std::copy_n(&tile->iters[from], w, &out.iters[to]);
+				std::copy_n(&tile->smooth[from], w, &out.smooth[to]);
+				std::copy_n(&tile->abs_z[from], w, &out.abs_z[to]);
+			}
+			thread_manager.colorize(in_shared, out, {col, row, col + w, row + h});
+			any = true;
+			// the cache has no orbits
+			out.resumable = false;
+		});
+
+		return any;
+	}
+
+	// Called once the frame is complete, the workers are idle then
+	void store_tiles()
+	{
+		for_each_tile([&](const TileCache::Key& key, const TileCache::Extent& extent, int col, int row) {
+			auto* tile = tile_cache.store(key, extent);
+			if (!tile)
+				return;
+
+			const int w = extent.x1 - extent.x0, h = extent.y1 - extent.y0;
+			for (int r = 0; r < h; r++)
+			{
+				const size_t from = (row + r) * width + col;
+				const size_t to = (extent.y0 + r) * TileCache::tile_size + extent.x0;
+				std::copy_n(&out.iters[from], w, &tile->iters[to]);
+				std::copy_n(&out.smooth[from], w, &tile->smooth[to]);
+				std::copy_n(&out.abs_z[from], w, &tile->abs_z[to]);
+			}
+		});
+	}
+
 	void update(float delta_time) override
 	{
+		if (cache_pending and out.complete) {
+			store_tiles();
+			cache_pending = false;
+		}
+
+		// a frame still being computed gets the new palette once it's done
+		if (cycling)
+			palette.phase = std::fmod(palette.phase + cycle_speed * delta_time, 2 * M_PIf);
+		if (palette != in_shared.palette and out.complete and !restart_pending)
+			recolor();
+
 		const float mi_rate = 100 * delta_time;
 
 		if (input.keyboard.map[XKB_KEY_i]) {
 			max_iterations += mi_rate;
-			refresh();
 		}
 		else if (input.keyboard.map[XKB_KEY_o]) {
 			if (max_iterations > mi_rate)
@@ -383,6 +1354,11 @@ private:
 				max_iterations = 1;
 			refresh();
 		}
+
+		// also after i is let go, a raise that came in while a frame was running waits for it
+		if (unsigned(max_iterations) != in_shared.max_iterations)
+			raise_iterations();
+		flush_restart();
 	}
 
 	void draw(Buffer* buffer, float delta_time) override
@@ -403,32 +1379,116 @@ private:
 
 		if (button == BTN_LEFT)
 		{
-			const ovec2 start {
-				in_shared.center.x - in_shared.range.x / 2,
-				in_shared.center.y - in_shared.range.y / 2
-			};
-			const ovec2 delta {
-				in_shared.range.x / width,
-				in_shared.range.y / height
-			};
-
+			// snapped to the pixel grid so most of the canvas can stay
 			const auto& cpos = input.pointer.pos;
-			const ovec2 coord(start.x + delta.x * cpos.x, start.y + delta.y * (height - cpos.y - 1));
-
-			center = coord;
+			pan(std::lround(cpos.x - width / 2.), std::lround(cpos.y + 1 - height / 2.));
+			return;
 		}
 		else if (button == BTN_RIGHT)
 		{
-			const float factor = 0.8;
-			if (!input.keyboard.map[XKB_KEY_Shift_L])
-				range *= factor;
-			else
-				range /= factor;
+			zoom += input.keyboard.map[XKB_KEY_Shift_L] ? -1 : 1;
+			range = level_range();
 		}
 
 		refresh();
 	}
 
+	// Moves the view by whole pixels, new (col, row) shows what old (col + shift_x, row + shift_y)
+	// did. A finished canvas is shifted in place and only the exposed strips get computed
+	void pan(int shift_x, int shift_y)
+	{
+		center.x += in_shared.delta.x * shift_x;
+		center.y -= in_shared.delta.y * shift_y;
+
+		if (!out.complete or restart_pending or !thread_manager.quiet() or std::abs(shift_x) >= width or std::abs(shift_y) >= height) {
+			refresh();
+			return;
+		}
+		if (shift_x == 0 and shift_y == 0)
+			return;
+
+		// |start| moves with the view, that may take another tier. Its orbits aren't
+		// sized and a canvas of two tiers won't do, everything gets iterated again
+		const Tier tier = in_shared.tier;
+		reassign_dynamic();
+		if (in_shared.tier != tier) {
+			refresh();
+			return;
+		}
+
+		shift_buffer(out.canvas, shift_x, shift_y);
+		shift_buffer(out.iters, shift_x, shift_y);
+		shift_buffer(out.smooth, shift_x, shift_y);
+		shift_buffer(out.abs_z, shift_x, shift_y);
+		with_tier(in_shared.tier, [&]<class T>(T) {
+			auto& orbits = std::get<Orbits<T>>(out.orbits);
+			shift_buffer(orbits.zr, shift_x, shift_y);
+			shift_buffer(orbits.zi, shift_x, shift_y);
+		});
+
+		// the exposed column strip at full height, then the row strip next to it
+		std::vector<Rect> strips;
+		if (shift_x != 0)
+			strips.push_back(shift_x > 0 ? Rect {width - shift_x, 0, width, height} : Rect {0, 0, -shift_x, height});
+		if (shift_y != 0) {
+			const int x0 = std::max(-shift_x, 0), x1 = width - std::max(shift_x, 0);
+			strips.push_back(shift_y > 0 ? Rect {x0, height - shift_y, x1, height} : Rect {x0, 0, x1, -shift_y});
+		}
+
+		// split along the long side, so every thread gets a piece
+		const int pieces = std::max(1u, thread_manager.num_threads() / 2);
+		std::vector<Command> cmds;
+		for (const Rect& strip : strips)
+		{
+			const bool tall = strip.y1 - strip.y0 > strip.x1 - strip.x0;
+			const int length = tall ? strip.y1 - strip.y0 : strip.x1 - strip.x0;
+			for (int i = 0; i < pieces; i++)
+			{
+				const int a = length * i / pieces, b = length * (i + 1) / pieces;
+				if (a == b)
+					continue;
+
+				Rect piece = strip;
+				if (tall) {
+					piece.y0 = strip.y0 + a;
+					piece.y1 = strip.y0 + b;
+				} else {
+					piece.x0 = strip.x0 + a;
+					piece.x1 = strip.x0 + b;
+				}
+
+				cmds.push_back({
+					.type = CommandType::rect,
+					.in_shared = &in_shared,
+					.out = &out,
+					.rect = piece,
+					.pass = in_shared.passes - 1,
+				});
+			}
+		}
+
+		out.pass_left = cmds.size();
+		out.complete = false;
+		thread_manager.enqueue(cmds.begin(), cmds.end());
+		thread_manager.release(cmds.size());
+		cache_pending = true;
+	}
+
+	template<class Buffer>
+	void shift_buffer(Buffer& buffer, int shift_x, int shift_y)
+	{
+		const int cols = width - std::abs(shift_x);
+		const int src_col = std::max(shift_x, 0), dst_col = std::max(-shift_x, 0);
+
+		// rows in the order that never reads one already overwritten
+		const int rows = height - std::abs(shift_y);
+		for (int i = 0; i < rows; i++)
+		{
+			const int row = shift_y >= 0 ? i : height - 1 - i;
+			memmove(&buffer[(row * width) + dst_col], &buffer[((row + shift_y) * width) + src_col], cols * sizeof(typename Buffer::value_type));
+		}
+	}
+
 	void on_key(xkb_keysym_t key, wl_keyboard_key_state state) override
 	{
 		if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
@@ -486,12 +1546,42 @@ private:
 					break;
 				}
 
+				if (what == 2 or what == 3)
+					rebase_zoom();
 				std::println("Set!");
 				refresh();
 			} break;
 
 			case XKB_KEY_a: {
 				correct_by_aspect();
+				rebase_zoom();
+				refresh();
+			} break;
+
+			case XKB_KEY_c: {
+				cycling = !cycling;
+				std::println("Colour cycling: {}", cycling ? "on" : "off");
+			} break;
+
+			case XKB_KEY_j: {
+				palette.density = std::max(palette.density / 2, Palette::min_density);
+				std::println("Palette density: {}", palette.density);
+			} break;
+
+			case XKB_KEY_k: {
+				palette.density = std::min(palette.density * 2, Palette::max_density);
+				std::println("Palette density: {}", palette.density);
+			} break;
+
+			case XKB_KEY_g: {
+				progressive = !progressive;
+				std::println("Progressive rendering: {}", progressive ? "on" : "off");
+				refresh();
+			} break;
+
+			case XKB_KEY_m: {
+				subdivide = !subdivide;
+				std::println("Mariani-Silver: {}", subdivide ? "on" : "off");
 				refresh();
 			} break;
 
@@ -500,12 +1590,14 @@ private:
 				range = {4, 4};
 				max_iterations = 40;
 				correct_by_aspect();
+				rebase_zoom();
 				refresh();
 			} break;
 
 			case XKB_KEY_l: {
 				std::println("Center: ({}, {})", center.x, center.y);
 				std::println("Range: ({}, {})", range.x, range.y);
+				std::println("Zoom level: {}", zoom);
 				std::println("Max iterations: {}", max_iterations);
 			} break;
 			}
@@ -513,12 +1605,92 @@ private:
 	}
 };
 
-int main()
+struct Args {
+    unsigned threads = 0;
+    std::vector<int> cpus;
+    bool bench = false;
+};
+
+// --threads N picks the pool size, --cpus LIST pins worker i onto the i-th CPU listed,
+// --bench times a frame at every worker count up to that instead of opening a window
+static Args parse_args(int argc, char** argv)
+{
+    Args args;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--help") {
+            std::println("usage: {} [--threads N] [--cpus LIST] [--bench]", argv[0]);
+            std::exit(0);
+        }
+        if (arg == "--bench") {
+            args.bench = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            throw std::runtime_error(std::format("unknown or incomplete argument '{}'", arg));
+
+        const std::string_view value = argv[++i];
+        if (arg == "--threads") {
+            int n;
+            if (!parse_whole(value, n) or n <= 0)
+                throw std::runtime_error(std::format("--threads wants a positive number, not '{}'", value));
+            args.threads = n;
+        } else if (arg == "--cpus") {
+            auto list = parse_cpu_list(value);
+            if (!list or list->empty())
+                throw std::runtime_error(std::format("--cpus wants a list like 0-7,16-23, not '{}'", value));
+            args.cpus = std::move(*list);
+        } else {
+            throw std::runtime_error(std::format("unknown argument '{}'", arg));
+        }
+    }
+    return args;
+}
+
+// The same frame on 1, 2, 4... workers up to the pool size, a fresh pool every time so
+// no tile cache carries over. The best of a few runs each, speedup against one worker
+static void bench(const Args& args)
+{
+    // what ThreadManager makes of them
+    const unsigned pool = args.threads != 0 ? args.threads : !args.cpus.empty() ? args.cpus.size() : std::max(std::thread::hardware_concurrency(), 1u);
+
+    double one = 0;
+    for (unsigned threads = 1;; threads = std::min(threads * 2, pool))
+    {
+        Fractal app(threads, args.cpus);
+        double best = app.bench_frame();
+        for (int run = 1; run < 3; run++)
+            best = std::min(best, app.bench_frame());
+        if (threads == 1)
+            one = best;
+
+        std::println("{:4} threads  {:8.3f} s  speedup {:6.2f}  efficiency {:5.1f}%",
+            threads, best, one / best, one / best / threads * 100);
+        if (threads == pool)
+            break;
+    }
+}
+
+int main(int argc, char** argv)
 {
     spdlog::set_level(spdlog::level::debug);
     spdlog::set_pattern("[%^%l%$ +%o] %v");
 
-    Fractal app;
+    Args args;
+    try {
+        args = parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::println(stderr, "{}", e.what());
+        return 2;
+    }
+
+    if (args.bench) {
+        bench(args);
+        return 0;
+    }
+
+    Fractal app(args.threads, std::move(args.cpus));
     try {
         app.initialize();
         app.run();
@@ -1,4 +1,8 @@
 #include "raytracer-new/app.hpp"
+#include "raytracer-new/work-deque.hpp"
+
+// Bands get halved down to this by whoever runs them, the other halves go up for stealing
+static constexpr int tile_rows = 16;
 
 template<class TBase, class TInShared, class TInPer, class TOut>
 class ThreadManager
@@ -10,8 +14,8 @@ public:
 		const TInShared* in_shared;
 		const TInPer* in_per;
 		TOut* out;
+		int row_start, row_end;
 	};
-	static constexpr std::ptrdiff_t semaphore_least_max_value = 64;
 
 private:
 	const TBase* app;
@@ -19,23 +23,33 @@ private:
 
 	std::vector<std::thread> workers;
 
-	std::counting_semaphore<semaphore_least_max_value> command_semaphore {0};
+	// Every worker has a deque of its own, what it splits off goes on the bottom of it and
+	// idle workers steal from the top. Commands from the main thread come through the
+	// injection queue. Sleeping workers wait on permits with atomic wait, idle counts the
+	// ones that are about to, so there's never more permits out than sleepers
+	std::atomic<unsigned> permits = 0;
+	std::unique_ptr<WorkDeque<Command>[]> deques;
 	std::mutex command_mutex;
 	std::queue<Command> command_queue;
+	std::atomic<unsigned> idle = 0;
+	// commands queued anywhere or being run, quits aside. Notified on reaching zero
+	std::atomic<unsigned> pending = 0;
 
 	std::unique_ptr<std::mutex[]> work_state;
-	std::vector<uint64_t> work_done;
+	std::vector<uint64_t> work_done, stolen_done;
 	std::atomic_bool stop = false;
 
 public:
 	ThreadManager(const TBase* app, unsigned nthreads = std::thread::hardware_concurrency())
 		:app(app), nthreads(nthreads)
 	{
-		iassert(nthreads < semaphore_least_max_value, "Too many threads you got brother. Increase the semaphore's least max value");
+		iassert(nthreads != 0);
 
 		work_state = std::make_unique<std::mutex[]>(nthreads);
 		memset(work_state.get(), 0x00, sizeof(std::mutex) * nthreads);
+		deques = std::make_unique<WorkDeque<Command>[]>(nthreads);
 		work_done.resize(nthreads, 0);
+		stolen_done.resize(nthreads, 0);
 
 		for (unsigned i : std::views::iota(0u, nthreads)) {
 			workers.emplace_back(ThreadManager::workplace, i, this);
@@ -51,6 +65,7 @@ public:
 	{
 		const Command& cmd_cref = cmd;
 		command_mutex.lock();
+		pending += count;
 		for (unsigned _ : std::views::iota(0u, count)) {
 			command_queue.push(cmd_cref);
 		}
@@ -62,6 +77,7 @@ public:
 	{
 		command_mutex.lock();
 		for (auto it = begin; it != end; it++) {
+			pending++;
 			command_queue.push(*it);
 		}
 		command_mutex.unlock();
@@ -71,36 +87,73 @@ public:
 	void enqueue(Func setter)
 	{
 		command_mutex.lock();
+		const size_t before = command_queue.size();
 		setter(command_queue);
+		pending += command_queue.size() - before;
 		command_mutex.unlock();
 	}
 
+	// What's queued, the deques get robbed like any thief would
 	void clear()
 	{
 		command_mutex.lock();
+		pending -= command_queue.size();
 		while (!command_queue.empty())
 			command_queue.pop();
 		command_mutex.unlock();
+
+		for (unsigned i : std::views::iota(0u, nthreads))
+			while (!deques[i].empty())
+				if (deques[i].steal())
+					pending--;
 	}
 
 	void halt()
 	{
-		clear();
 		stop = true;
+		clear();
 
+		// a worker may have checked stop just before it went up and split something off,
+		// while stopping they drop whatever they find
+		wait();
+
+		stop = false;
+	}
+
+	// Done once there's nothing anywhere
+	void wait()
+	{
+		for (unsigned left; (left = pending) != 0;)
+			pending.wait(left);
+	}
+
+	void wait_all()
+	{
 		for (unsigned i : std::views::iota(0u, nthreads))
 		{
 			work_state[i].lock();
 			work_state[i].unlock();
 		}
-
-		stop = false;
 	}
 
-	// WARNING: Don't release if the semaphore counter is at its max capacity
-	void release(std::ptrdiff_t update = 1)
+	// Wakes up to update sleeping workers, the ones awake find the work on their own
+	void release(unsigned update = 1)
 	{
-		command_semaphore.release(update);
+		// the work has to be out before idle is looked at, sleep() does it the other way round
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		unsigned sleeping = idle;
+		unsigned woken;
+		do {
+			woken = std::min(update, sleeping);
+			if (woken == 0)
+				return;
+		} while (!idle.compare_exchange_weak(sleeping, sleeping - woken));
+
+		permits += woken;
+		if (woken == 1)
+			permits.notify_one();
+		else
+			permits.notify_all();
 	}
 
 	~ThreadManager()
@@ -108,24 +161,19 @@ public:
 		Command cmd_quit = {.type = CommandType::quit};
 
 		// Filling in the command queues
+		stop = true;
+		clear();
 		command_mutex.lock();
-		while (!command_queue.empty())
-			command_queue.pop();
 		for (unsigned _ : std::views::iota(0u, nthreads))
 			command_queue.push(cmd_quit);
 		command_mutex.unlock();
 
 		// Signalling
-		stop = true;
 		release(nthreads);
 
 		// Waiting
 		std::println(stderr, "Waiting for {} threads to quit...", nthreads);
-		for (unsigned i : std::views::iota(0u, nthreads))
-		{
-			work_state[i].lock();
-			work_state[i].unlock();
-		}
+		wait_all();
 		for (auto& thread : workers)
 		{
 			thread.join();
@@ -142,6 +190,7 @@ public:
 			double dist = work_done[i] / double(total_work_done);
 			oss << dist * 100 << "%, ";
 		}
+		oss << "stolen = " << std::accumulate(stolen_done.begin(), stolen_done.end(), uint64_t(0));
 
 		spdlog::debug(oss.str());
 	}
@@ -153,30 +202,30 @@ private:
 
 		while (true)
 		{
-			mgr->command_semaphore.acquire();
-			mgr->command_mutex.lock();
-			if (mgr->command_queue.empty()) {
-				mgr->command_mutex.unlock();
+			const std::optional<Command> found = mgr->find(id);
+			if (!found) {
+				mgr->sleep();
 				continue;
 			}
-			Command cmd = mgr->command_queue.front();
-			mgr->command_queue.pop();
-			mgr->command_mutex.unlock();
+			Command cmd = *found;
 
 			// spdlog::debug("{}: Commanded {}", id, cmd.type == CommandType::quit ? "quit" : "work");
 
 			if (cmd.type == CommandType::quit)
 				break;
 
-			// Work
+			// Work, unless halting, then it's dropped
+			if (!mgr->stop)
 			{
 			std::lock_guard<std::mutex> lg(mgr->work_state[id]);
 
+			split(id, mgr, cmd);
+
 			[[maybe_unused]] const int width = cmd.in_shared->width, height = cmd.in_shared->height;
-			const auto at_begin = at(0, cmd.in_per->row_start, width);
+			const auto at_begin = at(0, cmd.row_start, width);
 
 			auto index = at_begin;
-			for (int row = cmd.in_per->row_start; row <= cmd.in_per->row_end; row++)
+			for (int row = cmd.row_start; row <= cmd.row_end; row++)
 			{
 				int count = 3000;
 				for (int x=0; x < count; x++)
@@ -196,6 +245,90 @@ private:
 
 			mgr->work_done[id]++;
 			}
+			if (--mgr->pending == 0)
+				mgr->pending.notify_all();
+		}
+	}
+
+	// Own deque first, newest first while it's still in cache, then the injection
+	// queue, then the oldest, biggest piece of somebody else's
+	std::optional<Command> find(unsigned id)
+	{
+		if (auto cmd = deques[id].pop())
+			return cmd;
+
+		command_mutex.lock();
+		if (!command_queue.empty()) {
+			const Command cmd = command_queue.front();
+			command_queue.pop();
+			command_mutex.unlock();
+			return cmd;
+		}
+		command_mutex.unlock();
+
+		for (unsigned k = 1; k < nthreads; k++)
+			if (auto cmd = deques[(id + k) % nthreads].steal()) {
+				stolen_done[id]++;
+				return cmd;
+			}
+		return std::nullopt;
+	}
+
+	// Something may have turned up between find() and idle going up, a releaser that saw
+	// idle up has a permit on its way though, take that or the claim back
+	void sleep()
+	{
+		idle++;
+
+		if (has_work())
+		{
+			unsigned sleeping = idle;
+			while (sleeping != 0 and !idle.compare_exchange_weak(sleeping, sleeping - 1));
+			if (sleeping != 0)
+				return;
+		}
+
+		// a permit, the counter is waited on directly
+		for (unsigned available = permits;;)
+		{
+			if (available == 0) {
+				permits.wait(0);
+				available = permits;
+			} else if (permits.compare_exchange_weak(available, available - 1)) {
+				return;
+			}
+		}
+	}
+
+	bool has_work()
+	{
+		command_mutex.lock();
+		const bool queued = !command_queue.empty();
+		command_mutex.unlock();
+		if (queued)
+			return true;
+
+		for (unsigned i : std::views::iota(0u, nthreads))
+			if (!deques[i].empty())
+				return true;
+		return false;
+	}
+
+	// Halves cmd while taller than tile_rows, the far halves go on the own deque unless halting
+	static void split(unsigned id, ThreadManager* mgr, Command& cmd)
+	{
+		while (cmd.row_end - cmd.row_start + 1 > tile_rows and !mgr->stop)
+		{
+			Command far = cmd;
+			far.row_start = cmd.row_start + (cmd.row_end - cmd.row_start + 1) / 2;
+
+			mgr->pending++;
+			if (!mgr->deques[id].push(far)) {
+				mgr->pending--;
+				break;
+			}
+			cmd.row_end = far.row_start - 1;
+			mgr->release();
 		}
 	}
 
@@ -234,12 +367,23 @@ class Raytracer : public App
 	using Command = decltype(thread_manager)::Command;
 	
 public:
-	Raytracer()
-		:thread_manager(this)
+	// nthreads of 0 is one per hardware thread
+	Raytracer(unsigned nthreads = 0)
+		:thread_manager(this, nthreads != 0 ? nthreads : std::max(std::thread::hardware_concurrency(), 1u))
 	{
 		title = "Raytracer";
 	}
 
+	// One frame at the window's default size, without a window. Seconds from the
+	// bands going out to the last one done
+	double bench_frame()
+	{
+		const auto begin = std::chrono::steady_clock::now();
+		resize();
+		thread_manager.wait();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
 private:
 	void setup_pre() override
 	{
@@ -298,6 +442,8 @@ private:
 			};
 			for (auto& ip : in_per) {
 				cmd.in_per = &ip;
+				cmd.row_start = ip.row_start;
+				cmd.row_end = ip.row_end;
 				queue.push(cmd);
 			}
 		};
@@ -333,12 +479,85 @@ private:
 	}
 };
 
-int main()
+struct Args {
+    unsigned threads = 0;
+    bool bench = false;
+};
+
+// --threads N picks the pool size, --bench times a frame at every worker count up to
+// that instead of opening a window
+static Args parse_args(int argc, char** argv)
+{
+    Args args;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--help") {
+            std::println("usage: {} [--threads N] [--bench]", argv[0]);
+            std::exit(0);
+        }
+        if (arg == "--bench") {
+            args.bench = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            throw std::runtime_error(std::format("unknown or incomplete argument '{}'", arg));
+
+        const std::string_view value = argv[++i];
+        if (arg == "--threads") {
+            int n;
+            if (!parse_whole(value, n) or n <= 0)
+                throw std::runtime_error(std::format("--threads wants a positive number, not '{}'", value));
+            args.threads = n;
+        } else {
+            throw std::runtime_error(std::format("unknown argument '{}'", arg));
+        }
+    }
+    return args;
+}
+
+// The same frame on 1, 2, 4... workers up to the pool size, a fresh pool every time.
+// The best of a few runs each, speedup against one worker
+static void bench(const Args& args)
+{
+    const unsigned pool = args.threads != 0 ? args.threads : std::max(std::thread::hardware_concurrency(), 1u);
+
+    double one = 0;
+    for (unsigned threads = 1;; threads = std::min(threads * 2, pool))
+    {
+        Raytracer app(threads);
+        double best = app.bench_frame();
+        for (int run = 1; run < 3; run++)
+            best = std::min(best, app.bench_frame());
+        if (threads == 1)
+            one = best;
+
+        std::println("{:4} threads  {:8.3f} s  speedup {:6.2f}  efficiency {:5.1f}%",
+            threads, best, one / best, one / best / threads * 100);
+        if (threads == pool)
+            break;
+    }
+}
+
+int main(int argc, char** argv)
 {
     spdlog::set_level(spdlog::level::debug);
     spdlog::set_pattern("[%^%l%$ +%o] %v");
 
-    Raytracer app;
+    Args args;
+    try {
+        args = parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::println(stderr, "{}", e.what());
+        return 2;
+    }
+
+    if (args.bench) {
+        bench(args);
+        return 0;
+    }
+
+    Raytracer app(args.threads);
     try {
         app.initialize();
         app.run();